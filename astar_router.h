@@ -0,0 +1,174 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <transport_router.pb.h>
+
+namespace graph {
+
+// маршрутизатор без предрасчёта: A* с нижней оценкой остатка пути до цели
+template <typename Weight>
+class AStarRouter: public IRouter<Weight> {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using typename IRouter<Weight>::RouteInfo;
+    // нижняя оценка веса пути от vertex до target, должна быть допустимой
+    // (не больше настоящего веса), иначе маршрут может оказаться не кратчайшим
+    using Heuristic = std::function<Weight(VertexId vertex, VertexId target)>;
+
+    AStarRouter(const Graph& graph, Heuristic heuristic);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const override;
+
+    // хранить нечего: поиск идёт прямо по замороженному графу
+    void Serialize(transport_router_serialize::TransportRouter &serialData) const override;
+    void Deserialize(const transport_router_serialize::TransportRouter &serialData) override;
+
+    SearchStats GetSearchStats() const override;
+    void SetBaselineStats(bool enabled) override;
+
+private:
+    // в очереди - оценка полного пути через вершину, вес пути до неё и сама вершина
+    using QueueItem = std::tuple<Weight, Weight, VertexId>;
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>>;
+
+    void CheckGraph() const;
+    // поиск от from до to, возвращает число раскрытых вершин; без эвристики - обычный Дейкстра
+    size_t Search(VertexId from, VertexId to, bool use_heuristic,
+                  std::vector<Weight>& weights, std::vector<std::optional<EdgeId>>& edges) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+    static constexpr Weight UNREACHABLE_WEIGHT = std::numeric_limits<Weight>::max();
+    const Graph& graph_;
+    Heuristic heuristic_;
+    mutable std::atomic<size_t> searches_{0};
+    mutable std::atomic<size_t> settled_vertices_{0};
+    std::atomic<bool> baseline_stats_{false};
+    mutable std::atomic<size_t> baseline_settled_vertices_{0};
+};
+
+template <typename Weight>
+AStarRouter<Weight>::AStarRouter(const Graph& graph, Heuristic heuristic)
+    : graph_(graph)
+    , heuristic_(std::move(heuristic))
+{
+    CheckGraph();
+}
+
+template <typename Weight>
+void AStarRouter<Weight>::CheckGraph() const {
+    if (graph_.GetVertexCount() > 0 && !graph_.IsFrozen()) {
+        throw std::logic_error("Graph should be frozen before routing");
+    }
+    const size_t edge_count = graph_.GetEdgeCount();
+    for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+        if (graph_.GetEdge(edge_id).weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+    }
+}
+
+template <typename Weight>
+std::optional<typename AStarRouter<Weight>::RouteInfo> AStarRouter<Weight>::BuildRoute(VertexId from,
+                                                                                       VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex is out of graph");
+    }
+
+    std::vector<Weight> weights;
+    std::vector<std::optional<EdgeId>> edges;
+    if (baseline_stats_) {
+        baseline_settled_vertices_ += Search(from, to, false, weights, edges);
+    }
+    const size_t settled_vertices = Search(from, to, true, weights, edges);
+    ++searches_;
+    settled_vertices_ += settled_vertices;
+
+    if (weights[to] == UNREACHABLE_WEIGHT) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> route_edges;
+    for (VertexId vertex = to; edges[vertex];) {
+        const EdgeId edge_id = *edges[vertex];
+        route_edges.push_back(edge_id);
+        vertex = graph_.GetEdge(edge_id).from;
+    }
+    std::reverse(route_edges.begin(), route_edges.end());
+
+    return RouteInfo{weights[to], std::move(route_edges)};
+}
+
+template <typename Weight>
+size_t AStarRouter<Weight>::Search(VertexId from, VertexId to, bool use_heuristic,
+                                   std::vector<Weight>& weights, std::vector<std::optional<EdgeId>>& edges) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    weights.assign(vertex_count, UNREACHABLE_WEIGHT);
+    edges.assign(vertex_count, std::nullopt);
+    auto estimate_rest = [&](VertexId vertex) {
+        return use_heuristic ? heuristic_(vertex, to) : ZERO_WEIGHT;
+    };
+    Queue queue;
+    weights[from] = ZERO_WEIGHT;
+    queue.push({estimate_rest(from), ZERO_WEIGHT, from});
+    size_t settled_vertices = 0;
+
+    while (!queue.empty()) {
+        const auto [estimate, weight, vertex] = queue.top();
+        queue.pop();
+        // устаревший элемент: вес вершины с тех пор уменьшился
+        if (weight > weights[vertex]) {
+            continue;
+        }
+        ++settled_vertices;
+        if (vertex == to) {
+            break;
+        }
+        const auto arcs = graph_.GetOutgoingArcs(vertex);
+        for (size_t i = 0; i < arcs.size; ++i) {
+            const VertexId next = arcs.vertices[i];
+            const Weight candidate_weight = weight + arcs.weights[i];
+            if (candidate_weight < weights[next]) {
+                weights[next] = candidate_weight;
+                edges[next] = arcs.edge_ids[i];
+                queue.push({candidate_weight + estimate_rest(next), candidate_weight, next});
+            }
+        }
+    }
+    return settled_vertices;
+}
+
+template <typename Weight>
+SearchStats AStarRouter<Weight>::GetSearchStats() const {
+    return {searches_.load(), settled_vertices_.load(), baseline_settled_vertices_.load()};
+}
+
+template <typename Weight>
+void AStarRouter<Weight>::SetBaselineStats(bool enabled) {
+    baseline_stats_ = enabled;
+}
+
+template <typename Weight>
+void AStarRouter<Weight>::Serialize(transport_router_serialize::TransportRouter &) const {
+}
+
+template <typename Weight>
+void AStarRouter<Weight>::Deserialize(const transport_router_serialize::TransportRouter &) {
+    CheckGraph();
+}
+
+}  // namespace graph
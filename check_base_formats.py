@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+# Проверка форматов базы: одна и та же сеть сохраняется во всех форматах,
+# и ответы process_requests текущей сборки по каждой базе должны совпасть.
+#
+#   protobuf-legacy - таблица маршрутов строками (исходный формат)
+#   packed          - таблица маршрутов плоскими массивами, одно сообщение
+#   streamed        - текущий формат protobuf: заголовок и куски таблицы
+#   flat            - выровненные секции (serialization_settings.format = "flat")
+#
+# Базы прежних форматов пишет сборка ревизии, где формат был текущим; ревизии
+# находятся по истории и собираются во временном worktree, готовые бинарники
+# можно передать через LEGACY_BIN и PACKED_BIN.
+#
+# Использование: check_base_formats.py [путь к transport_catalogue] [seed...]
+
+import json
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+REPO = os.path.dirname(os.path.abspath(__file__))
+
+
+def git(*args):
+    return subprocess.run(['git', '-C', REPO] + list(args), check=True,
+                          capture_output=True, text=True).stdout.strip()
+
+
+def legacy_revision():
+    # строки таблицы писала исходная ревизия
+    return git('rev-list', '--max-parents=0', 'HEAD').splitlines()[0]
+
+
+def packed_revision():
+    # последняя ревизия, писавшая базу одним сообщением: до появления WriteRouterChunk
+    commits = git('log', '--format=%H', '-S', 'WriteRouterChunk', '--', 'serialization.cpp').splitlines()
+    return commits[-1] + '^'
+
+
+def build_revision(revision, work_dir):
+    source = os.path.join(work_dir, 'src')
+    build = os.path.join(work_dir, 'build')
+    git('worktree', 'add', '--detach', source, revision)
+    try:
+        subprocess.run(['cmake', '-S', source, '-B', build, '-DCMAKE_BUILD_TYPE=Release'],
+                       check=True, stdout=subprocess.DEVNULL)
+        subprocess.run(['cmake', '--build', build, '-j', str(os.cpu_count() or 1)],
+                       check=True, stdout=subprocess.DEVNULL)
+    finally:
+        git('worktree', 'remove', '--force', source)
+    return os.path.join(build, 'transport_catalogue')
+
+
+def make_network(seed, stop_count=60, bus_count=18, request_count=300):
+    rnd = random.Random(seed)
+    stops = ['Stop {}'.format(i) for i in range(stop_count)]
+    base = []
+    for name in stops:
+        base.append({'type': 'Stop', 'name': name,
+                     'latitude': 55.5 + rnd.random() * 0.3,
+                     'longitude': 37.4 + rnd.random() * 0.4,
+                     'road_distances': {}})
+    by_name = {stop['name']: stop for stop in base}
+    buses = []
+    for i in range(bus_count):
+        route = rnd.sample(stops, rnd.randint(2, 10))
+        is_roundtrip = rnd.random() < 0.4
+        if is_roundtrip:
+            route.append(route[0])
+        for a, b in zip(route, route[1:]):
+            by_name[a]['road_distances'].setdefault(b, rnd.randint(300, 6000))
+        buses.append({'type': 'Bus', 'name': 'Bus{}'.format(i), 'stops': route, 'is_roundtrip': is_roundtrip})
+    base += buses
+    rnd.shuffle(base)
+
+    requests = []
+    for i in range(request_count):
+        kind = rnd.random()
+        if kind < 0.1:
+            requests.append({'id': i, 'type': 'Bus', 'name': rnd.choice(buses)['name']})
+        elif kind < 0.2:
+            requests.append({'id': i, 'type': 'Stop', 'name': rnd.choice(stops)})
+        else:
+            requests.append({'id': i, 'type': 'Route', 'from': rnd.choice(stops), 'to': rnd.choice(stops)})
+    requests.append({'id': request_count, 'type': 'Map'})
+
+    settings = {
+        'routing_settings': {'bus_wait_time': rnd.randint(1, 10), 'bus_velocity': rnd.randint(20, 50)},
+        'render_settings': {
+            'width': 1200, 'height': 500, 'padding': 50, 'stop_radius': 5, 'line_width': 14,
+            'bus_label_font_size': 20, 'bus_label_offset': [7, 15],
+            'stop_label_font_size': 18, 'stop_label_offset': [7, -3],
+            'underlayer_color': [255, 255, 255, 0.85], 'underlayer_width': 3,
+            'color_palette': ['green', [255, 160, 0], 'red'],
+        },
+    }
+    return base, settings, requests
+
+
+def run(binary, mode, document):
+    result = subprocess.run([binary, mode], input=json.dumps(document), capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError('{} {} failed: {}'.format(binary, mode, result.stderr.strip()))
+    return result.stdout
+
+
+def first_difference(expected, actual):
+    for left, right in zip(expected, actual):
+        if left != right:
+            return left.get('request_id')
+    return None
+
+
+def check_seed(seed, current, writers, work_dir):
+    base, settings, requests = make_network(seed)
+    answers = {}
+    for name, binary, serialization in writers:
+        serialization = dict(serialization, file=os.path.join(work_dir, '{}.db'.format(name)))
+        run(binary, 'make_base', dict(settings, serialization_settings=serialization, base_requests=base))
+        output = run(current, 'process_requests', {'serialization_settings': serialization, 'stat_requests': requests})
+        answers[name] = json.loads(output)
+
+    ok = True
+    expected = answers['streamed']
+    for name, actual in answers.items():
+        if actual == expected:
+            print('seed {}: {} OK'.format(seed, name))
+        else:
+            ok = False
+            print('seed {}: {} differs from streamed, first at request {}'.format(
+                seed, name, first_difference(expected, actual)))
+    return ok
+
+
+def main():
+    current = os.path.abspath(sys.argv[1]) if len(sys.argv) > 1 else os.path.join(REPO, 'build', 'transport_catalogue')
+    seeds = [int(seed) for seed in sys.argv[2:]] or [1, 2, 3]
+    with tempfile.TemporaryDirectory() as work_dir:
+        legacy = os.environ.get('LEGACY_BIN') or build_revision(legacy_revision(), os.path.join(work_dir, 'legacy'))
+        packed = os.environ.get('PACKED_BIN') or build_revision(packed_revision(), os.path.join(work_dir, 'packed'))
+        writers = [
+            ('protobuf-legacy', legacy, {}),
+            ('packed', packed, {}),
+            ('streamed', current, {}),
+            ('flat', current, {'format': 'flat'}),
+        ]
+        ok = all([check_seed(seed, current, writers, work_dir) for seed in seeds])
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
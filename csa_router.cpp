@@ -0,0 +1,100 @@
+#include "csa_router.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+using namespace std;
+
+namespace csa {
+
+CsaRouter::CsaRouter(size_t stop_count, const std::vector<Trip>& trips)
+    : stop_count_(stop_count)
+    , trip_count_(trips.size()) {
+    trip_buses_.reserve(trips.size());
+    for (size_t trip = 0; trip < trips.size(); trip++) {
+        const auto &stops = trips[trip].stops;
+        const auto &times = trips[trip].times;
+        if (stops.size() != times.size()) {
+            throw invalid_argument("Trip stops and times size mismatch");
+        }
+        trip_buses_.push_back(trips[trip].bus_id);
+        for (size_t position = 1; position < stops.size(); position++) {
+            if (stops[position - 1] >= stop_count_ || stops[position] >= stop_count_) {
+                throw out_of_range("Stop is out of router");
+            }
+            connections_.push_back({times[position - 1], times[position],
+                                    static_cast<uint32_t>(stops[position - 1]), static_cast<uint32_t>(stops[position]),
+                                    static_cast<uint32_t>(trip), static_cast<uint32_t>(position)});
+        }
+    }
+    // перегоны нулевой длины с одинаковым временем идут в порядке следования по рейсу
+    sort(connections_.begin(), connections_.end(), [](const Connection &lhs, const Connection &rhs) {
+        return tie(lhs.departure, lhs.arrival, lhs.trip, lhs.position)
+            < tie(rhs.departure, rhs.arrival, rhs.trip, rhs.position);
+    });
+}
+
+size_t CsaRouter::GetConnectionCount() const {
+    return connections_.size();
+}
+
+std::optional<Journey> CsaRouter::BuildRoute(StopId from, StopId to, double departure_time) const {
+    if (from >= stop_count_ || to >= stop_count_) {
+        throw out_of_range("Stop is out of router");
+    }
+    if (from == to) {
+        return Journey{departure_time, {}};
+    }
+
+    vector<double> arrivals(stop_count_, UNREACHABLE);
+    // перегон, которым достигнута остановка, и перегон посадки на его рейс
+    vector<uint32_t> arrival_connections(stop_count_, NO_CONNECTION);
+    vector<uint32_t> board_connections(stop_count_, NO_CONNECTION);
+    // перегон посадки на рейс, если на него уже удалось сесть
+    vector<uint32_t> trip_boardings(trip_count_, NO_CONNECTION);
+    arrivals[from] = departure_time;
+
+    auto it = lower_bound(connections_.begin(), connections_.end(), departure_time,
+                          [](const Connection &connection, double time) {
+                              return connection.departure < time;
+                          });
+    for (; it != connections_.end(); ++it) {
+        const Connection &connection = *it;
+        // дальше отправления только позже уже найденного прибытия в цель
+        if (arrivals[to] <= connection.departure) {
+            break;
+        }
+        const uint32_t index = static_cast<uint32_t>(it - connections_.begin());
+        uint32_t &boarding = trip_boardings[connection.trip];
+        if (boarding == NO_CONNECTION) {
+            if (arrivals[connection.from_stop] > connection.departure) {
+                continue;
+            }
+            boarding = index;
+        }
+        if (connection.arrival < arrivals[connection.to_stop]) {
+            arrivals[connection.to_stop] = connection.arrival;
+            arrival_connections[connection.to_stop] = index;
+            board_connections[connection.to_stop] = boarding;
+        }
+    }
+
+    if (arrivals[to] == UNREACHABLE) {
+        return nullopt;
+    }
+    Journey journey{arrivals[to], {}};
+    for (StopId stop = to; stop != from;) {
+        const Connection &alight = connections_[arrival_connections[stop]];
+        const Connection &board = connections_[board_connections[stop]];
+        const StopId board_stop = board.from_stop;
+        journey.legs.push_back({trip_buses_[board.trip], board_stop, board.departure - arrivals[board_stop],
+                                static_cast<int>(alight.position - board.position + 1),
+                                alight.arrival - board.departure});
+        stop = board_stop;
+    }
+    reverse(journey.legs.begin(), journey.legs.end());
+    return journey;
+}
+
+}  // namespace csa
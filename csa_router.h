@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace csa {
+
+using StopId = size_t;
+
+// один рейс автобуса: остановки и время прибытия (отправления) на каждую из них
+struct Trip {
+    size_t bus_id;
+    std::vector<StopId> stops;
+    std::vector<double> times;
+};
+
+// участок пути на одном рейсе
+struct Leg {
+    size_t bus_id;
+    StopId board_stop;
+    // ожидание рейса на остановке посадки
+    double wait_time;
+    int span_count;
+    double ride_time;
+};
+
+struct Journey {
+    double arrival_time;
+    std::vector<Leg> legs;
+};
+
+// поиск по расписанию (Connection Scan): все перегоны всех рейсов лежат в одном
+// массиве по времени отправления, запрос - один линейный проход по нему
+class CsaRouter {
+public:
+    CsaRouter() = default;
+    explicit CsaRouter(size_t stop_count, const std::vector<Trip>& trips);
+
+    // самое раннее прибытие в to при появлении на остановке from в момент departure_time
+    std::optional<Journey> BuildRoute(StopId from, StopId to, double departure_time) const;
+
+    size_t GetConnectionCount() const;
+
+private:
+    static constexpr double UNREACHABLE = std::numeric_limits<double>::infinity();
+    static constexpr uint32_t NO_CONNECTION = std::numeric_limits<uint32_t>::max();
+
+    // перегон между соседними остановками рейса
+    struct Connection {
+        double departure;
+        double arrival;
+        uint32_t from_stop;
+        uint32_t to_stop;
+        uint32_t trip;
+        uint32_t position;
+    };
+
+    size_t stop_count_ = 0;
+    size_t trip_count_ = 0;
+    std::vector<Connection> connections_;
+    std::vector<size_t> trip_buses_;
+};
+
+}  // namespace csa
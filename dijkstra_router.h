@@ -0,0 +1,309 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <transport_router.pb.h>
+
+namespace graph {
+
+// маршрутизатор без предрасчёта: двунаправленный Дейкстра на каждый запрос
+template <typename Weight>
+class DijkstraRouter: public IRouter<Weight> {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using typename IRouter<Weight>::RouteInfo;
+
+    explicit DijkstraRouter(const Graph& graph);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const override;
+    // одно дерево кратчайших путей из from, поиск останавливается после всех целей
+    std::vector<std::optional<RouteInfo>> BuildRoutes(VertexId from, const std::vector<VertexId>& to) const override;
+
+    // хранить нечего: поиск идёт прямо по замороженному графу
+    void Serialize(transport_router_serialize::TransportRouter &serialData) const override;
+    void Deserialize(const transport_router_serialize::TransportRouter &serialData) override;
+
+    SearchStats GetSearchStats() const override;
+
+private:
+    using QueueItem = std::pair<Weight, VertexId>;
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>>;
+
+    // состояние поиска в одном направлении
+    struct SearchState {
+        std::vector<Weight> weights;
+        std::vector<std::optional<EdgeId>> edges;
+        Queue queue;
+
+        SearchState(size_t vertex_count, VertexId start)
+            : weights(vertex_count, UNREACHABLE_WEIGHT)
+            , edges(vertex_count) {
+            weights[start] = ZERO_WEIGHT;
+            queue.push({ZERO_WEIGHT, start});
+        }
+
+        // удаление устаревших элементов с вершины очереди
+        void SkipStale() {
+            while (!queue.empty() && queue.top().first > weights[queue.top().second]) {
+                queue.pop();
+            }
+        }
+    };
+
+    void CheckGraph() const;
+
+    // раскрытие вершины в прямом (forward) или обратном направлении
+    void ExpandVertex(SearchState& state, const SearchState& opposite, bool forward,
+                      Weight& best_weight, std::optional<VertexId>& meeting_vertex) const;
+
+    void CountSearch(size_t settled_vertices) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+    static constexpr Weight UNREACHABLE_WEIGHT = std::numeric_limits<Weight>::max();
+    const Graph& graph_;
+    // поиски идут из нескольких потоков обработки запросов
+    mutable std::atomic<size_t> searches_{0};
+    mutable std::atomic<size_t> settled_vertices_{0};
+};
+
+template <typename Weight>
+DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph)
+    : graph_(graph)
+{
+    CheckGraph();
+}
+
+template <typename Weight>
+void DijkstraRouter<Weight>::CheckGraph() const {
+    if (graph_.GetVertexCount() > 0 && !graph_.IsFrozen()) {
+        throw std::logic_error("Graph should be frozen before routing");
+    }
+    const size_t edge_count = graph_.GetEdgeCount();
+    for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+        if (graph_.GetEdge(edge_id).weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+    }
+}
+
+template <typename Weight>
+void DijkstraRouter<Weight>::ExpandVertex(SearchState& state, const SearchState& opposite, bool forward,
+                                          Weight& best_weight, std::optional<VertexId>& meeting_vertex) const {
+    const auto [weight, vertex] = state.queue.top();
+    state.queue.pop();
+
+    const auto arcs = forward ? graph_.GetOutgoingArcs(vertex) : graph_.GetIncomingArcs(vertex);
+    for (size_t i = 0; i < arcs.size; ++i) {
+        const VertexId next = arcs.vertices[i];
+        const Weight candidate_weight = weight + arcs.weights[i];
+        if (candidate_weight < state.weights[next]) {
+            state.weights[next] = candidate_weight;
+            state.edges[next] = arcs.edge_ids[i];
+            state.queue.push({candidate_weight, next});
+        }
+        if (opposite.weights[next] != UNREACHABLE_WEIGHT
+            && state.weights[next] + opposite.weights[next] < best_weight) {
+            best_weight = state.weights[next] + opposite.weights[next];
+            meeting_vertex = next;
+        }
+    }
+}
+
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::RouteInfo> DijkstraRouter<Weight>::BuildRoute(VertexId from,
+                                                                                             VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex is out of graph");
+    }
+    if (from == to) {
+        return RouteInfo{ZERO_WEIGHT, {}};
+    }
+
+    SearchState forward_state(vertex_count, from);
+    SearchState backward_state(vertex_count, to);
+    Weight best_weight = UNREACHABLE_WEIGHT;
+    std::optional<VertexId> meeting_vertex;
+    size_t settled_vertices = 0;
+
+    while (true) {
+        forward_state.SkipStale();
+        backward_state.SkipStale();
+        if (forward_state.queue.empty() || backward_state.queue.empty()) {
+            break;
+        }
+        const Weight forward_top = forward_state.queue.top().first;
+        const Weight backward_top = backward_state.queue.top().first;
+        if (best_weight != UNREACHABLE_WEIGHT && forward_top + backward_top >= best_weight) {
+            break;
+        }
+        // раскрывается направление с меньшим фронтом
+        ++settled_vertices;
+        if (forward_state.queue.size() <= backward_state.queue.size()) {
+            ExpandVertex(forward_state, backward_state, true, best_weight, meeting_vertex);
+        } else {
+            ExpandVertex(backward_state, forward_state, false, best_weight, meeting_vertex);
+        }
+    }
+    CountSearch(settled_vertices);
+
+    if (!meeting_vertex) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> edges;
+    for (VertexId vertex = *meeting_vertex; forward_state.edges[vertex];) {
+        const EdgeId edge_id = *forward_state.edges[vertex];
+        edges.push_back(edge_id);
+        vertex = graph_.GetEdge(edge_id).from;
+    }
+    std::reverse(edges.begin(), edges.end());
+    for (VertexId vertex = *meeting_vertex; backward_state.edges[vertex];) {
+        const EdgeId edge_id = *backward_state.edges[vertex];
+        edges.push_back(edge_id);
+        vertex = graph_.GetEdge(edge_id).to;
+    }
+
+    return RouteInfo{best_weight, std::move(edges)};
+}
+
+template <typename Weight>
+std::vector<std::optional<typename DijkstraRouter<Weight>::RouteInfo>>
+DijkstraRouter<Weight>::BuildRoutes(VertexId from, const std::vector<VertexId>& to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count) {
+        throw std::out_of_range("Vertex is out of graph");
+    }
+    std::vector<bool> is_target(vertex_count, false);
+    size_t targets_left = 0;
+    for (VertexId vertex : to) {
+        if (vertex >= vertex_count) {
+            throw std::out_of_range("Vertex is out of graph");
+        }
+        if (!is_target[vertex]) {
+            is_target[vertex] = true;
+            ++targets_left;
+        }
+    }
+
+    SearchState state(vertex_count, from);
+    size_t settled_vertices = 0;
+    while (targets_left > 0) {
+        state.SkipStale();
+        if (state.queue.empty()) {
+            break;
+        }
+        const auto [weight, vertex] = state.queue.top();
+        state.queue.pop();
+        ++settled_vertices;
+        if (is_target[vertex]) {
+            is_target[vertex] = false;
+            --targets_left;
+        }
+        const auto arcs = graph_.GetOutgoingArcs(vertex);
+        for (size_t i = 0; i < arcs.size; ++i) {
+            const VertexId next = arcs.vertices[i];
+            const Weight candidate_weight = weight + arcs.weights[i];
+            if (candidate_weight < state.weights[next]) {
+                state.weights[next] = candidate_weight;
+                state.edges[next] = arcs.edge_ids[i];
+                state.queue.push({candidate_weight, next});
+            }
+        }
+    }
+    CountSearch(settled_vertices);
+
+    std::vector<std::optional<RouteInfo>> routes;
+    routes.reserve(to.size());
+    for (VertexId vertex : to) {
+        if (state.weights[vertex] == UNREACHABLE_WEIGHT) {
+            routes.push_back(std::nullopt);
+            continue;
+        }
+        std::vector<EdgeId> edges;
+        for (VertexId current = vertex; state.edges[current];) {
+            const EdgeId edge_id = *state.edges[current];
+            edges.push_back(edge_id);
+            current = graph_.GetEdge(edge_id).from;
+        }
+        std::reverse(edges.begin(), edges.end());
+        routes.push_back(RouteInfo{state.weights[vertex], std::move(edges)});
+    }
+    return routes;
+}
+
+template <typename Weight>
+void DijkstraRouter<Weight>::CountSearch(size_t settled_vertices) const {
+    ++searches_;
+    settled_vertices_ += settled_vertices;
+}
+
+template <typename Weight>
+SearchStats DijkstraRouter<Weight>::GetSearchStats() const {
+    return {searches_.load(), settled_vertices_.load()};
+}
+
+template <typename Weight>
+void DijkstraRouter<Weight>::Serialize(transport_router_serialize::TransportRouter &) const {
+}
+
+template <typename Weight>
+void DijkstraRouter<Weight>::Deserialize(const transport_router_serialize::TransportRouter &) {
+    CheckGraph();
+}
+
+// ограниченный Дейкстра: вершины, достижимые из from с весом не больше max_weight,
+// по возрастанию веса; поиск заканчивается на первой вершине за границей
+template <typename Weight>
+std::vector<std::pair<VertexId, Weight>> BuildReachableVertices(const DirectedWeightedGraph<Weight>& graph,
+                                                                VertexId from, Weight max_weight) {
+    using QueueItem = std::pair<Weight, VertexId>;
+    const size_t vertex_count = graph.GetVertexCount();
+    if (from >= vertex_count) {
+        throw std::out_of_range("Vertex is out of graph");
+    }
+    if (!graph.IsFrozen()) {
+        throw std::logic_error("Graph should be frozen before routing");
+    }
+
+    std::vector<std::pair<VertexId, Weight>> reachable;
+    std::vector<Weight> weights(vertex_count, std::numeric_limits<Weight>::max());
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+    weights[from] = Weight{};
+    queue.push({Weight{}, from});
+    while (!queue.empty()) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (weight > weights[vertex]) {
+            continue;
+        }
+        if (weight > max_weight) {
+            break;
+        }
+        reachable.emplace_back(vertex, weight);
+        const auto arcs = graph.GetOutgoingArcs(vertex);
+        for (size_t i = 0; i < arcs.size; ++i) {
+            const VertexId next = arcs.vertices[i];
+            const Weight candidate_weight = weight + arcs.weights[i];
+            if (candidate_weight < weights[next]) {
+                weights[next] = candidate_weight;
+                queue.push({candidate_weight, next});
+            }
+        }
+    }
+    return reachable;
+}
+
+}  // namespace graph
@@ -25,6 +25,12 @@ struct BusRoute  {
     std::vector<std::string> Stops;
 };       
     
+// расписание автобуса: отправления рейсов с начальной остановки (мин от начала суток)
+struct BusTimetable {
+    std::string Number;
+    std::vector<double> Departures;
+};
+    
 struct RoutesStop {
     std::string Name;
     geo::Coordinates Coord;
@@ -35,6 +41,7 @@ struct RoutesStop {
 struct InputData {
     std::vector<BusRoute> ListBuses;
     std::vector<RoutesStop> ListStops;   
+    std::vector<BusTimetable> Timetables;
 }; 
 
 struct BusInfo {
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+namespace fingerprint {
+
+// FNV-1a, не зависит от запуска в отличие от std::hash
+class FingerprintBuilder {
+public:
+    template <typename T>
+    void Add(T value) {
+        static_assert(std::is_arithmetic_v<T>, "Only numbers are hashed by value");
+        AddBytes(&value, sizeof(value));
+    }
+
+    // длина впереди, чтобы соседние строки не склеивались
+    void Add(std::string_view text) {
+        Add(static_cast<uint64_t>(text.size()));
+        AddBytes(text.data(), text.size());
+    }
+
+    // 0 не выдаётся: он означает отсутствие отпечатка
+    uint64_t Get() const {
+        return hash_ != 0 ? hash_ : 1;
+    }
+
+private:
+    uint64_t hash_ = 14695981039346656037ULL;
+
+    void AddBytes(const void *data, size_t size) {
+        const auto *bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash_ = (hash_ ^ bytes[i]) * 1099511628211ULL;
+        }
+    }
+};
+
+}  // namespace fingerprint
@@ -0,0 +1,190 @@
+#include "flat_base.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FLAT_BASE_MMAP 1
+#endif
+
+using namespace std;
+
+namespace flat {
+
+namespace {
+
+const char MAGIC[8] = {'T', 'C', 'F', 'L', 'A', 'T', '\r', '\n'};
+const uint32_t VERSION = 1;
+// записывается как есть: при другом порядке байтов читается иначе
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const size_t SECTION_ALIGNMENT = 64;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t section_count;
+};
+
+struct SectionRecord {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+size_t AlignUp(size_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string& file_name) {
+#ifdef FLAT_BASE_MMAP
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open base file: "s + file_name);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw runtime_error("Cannot read base file: "s + file_name);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("Cannot map base file: "s + file_name);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    // отображение остаётся действительным и после закрытия файла
+    close(fd);
+#else
+    ifstream ifs(file_name, ios::binary);
+    if (!ifs) {
+        throw runtime_error("Cannot open base file: "s + file_name);
+    }
+    buffer_.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef FLAT_BASE_MMAP
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+const char* MappedFile::GetData() const {
+    return data_;
+}
+
+size_t MappedFile::GetSize() const {
+    return size_;
+}
+
+void BaseWriter::AddSection(SectionId id, std::string_view bytes) {
+    sections_.push_back({id, string(bytes), nullptr, bytes.size()});
+}
+
+bool BaseWriter::WriteToFile(const std::string& file_name) const {
+    FileHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.section_count = sections_.size();
+
+    vector<SectionRecord> records;
+    size_t offset = AlignUp(sizeof(FileHeader) + sections_.size() * sizeof(SectionRecord));
+    for (const auto& section : sections_) {
+        records.push_back({static_cast<uint32_t>(section.id), 0, offset, section.size});
+        offset = AlignUp(offset + section.size);
+    }
+
+    ofstream ofs(file_name, ios::binary);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(SectionRecord));
+    size_t position = sizeof(FileHeader) + records.size() * sizeof(SectionRecord);
+    const string padding(SECTION_ALIGNMENT, '\0');
+    for (size_t i = 0; i < sections_.size(); i++) {
+        ofs.write(padding.data(), records[i].offset - position);
+        const auto& section = sections_[i];
+        ofs.write(section.view != nullptr ? section.view : section.owned.data(), section.size);
+        position = records[i].offset + sections_[i].size;
+    }
+    return static_cast<bool>(ofs);
+}
+
+BaseReader::BaseReader(const std::string& file_name)
+    : file_(make_shared<MappedFile>(file_name)) {
+    const char* data = file_->GetData();
+    const size_t size = file_->GetSize();
+    FileHeader header;
+    if (size < sizeof(header)) {
+        throw runtime_error("Flat base is too short");
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw runtime_error("Not a flat base");
+    }
+    if (header.version != VERSION || header.byte_order != BYTE_ORDER_MARK) {
+        throw runtime_error("Unsupported flat base version or byte order");
+    }
+    if (header.section_count > (size - sizeof(header)) / sizeof(SectionRecord)) {
+        throw runtime_error("Flat base section table is truncated");
+    }
+    for (uint64_t i = 0; i < header.section_count; i++) {
+        SectionRecord record;
+        memcpy(&record, data + sizeof(header) + i * sizeof(SectionRecord), sizeof(record));
+        if (record.offset > size || record.size > size - record.offset) {
+            throw runtime_error("Flat base section is out of file");
+        }
+        sections_.emplace_back(static_cast<SectionId>(record.id), string_view(data + record.offset, record.size));
+    }
+}
+
+bool BaseReader::IsFlatBase(const std::string& file_name) {
+    ifstream ifs(file_name, ios::binary);
+    char magic[sizeof(MAGIC)];
+    return ifs.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool BaseReader::HasSection(SectionId id) const {
+    return any_of(sections_.begin(), sections_.end(), [id](const auto& section) {
+        return section.first == id;
+    });
+}
+
+std::vector<SectionId> BaseReader::GetSectionIds() const {
+    vector<SectionId> result;
+    result.reserve(sections_.size());
+    for (const auto& section : sections_) {
+        result.push_back(section.first);
+    }
+    return result;
+}
+
+std::string_view BaseReader::GetSection(SectionId id) const {
+    for (const auto& [section_id, bytes] : sections_) {
+        if (section_id == id) {
+            return bytes;
+        }
+    }
+    throw runtime_error("Flat base has no section "s + to_string(static_cast<uint32_t>(id)));
+}
+
+std::shared_ptr<const MappedFile> BaseReader::GetFile() const {
+    return file_;
+}
+
+}  // namespace flat
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace flat {
+
+// плоская база: заголовок, таблица секций и секции, выровненные по SECTION_ALIGNMENT;
+// секции - массивы записей фиксированного размера в порядке байтов машины,
+// при загрузке файл отображается в память и массивы читаются прямо из отображения
+
+// номера секций
+enum class SectionId : std::uint32_t {
+    PROTO = 1,              // Catalogue без тяжёлых полей: настройки, расписания и т.п.
+    STOP_NAMES = 2,         // названия остановок подряд, char
+    STOP_NAME_OFFSETS = 3,  // начала названий, uint32_t [число остановок + 1]
+    STOP_COORDS = 4,        // CoordinatesRecord
+    BUS_NAMES = 5,          // номера автобусов подряд, char
+    BUS_NAME_OFFSETS = 6,   // начала номеров, uint32_t [число автобусов + 1]
+    BUS_IS_LOOP = 7,        // uint8_t
+    BUS_STOP_OFFSETS = 8,   // начала списков остановок, uint32_t [число автобусов + 1]
+    BUS_STOPS = 9,          // номера остановок маршрутов, uint32_t
+    DISTANCES = 10,         // DistanceRecord
+    GRAPH_EDGES = 11,       // EdgeRecord
+    EDGE_INFO = 12,         // EdgeInfoRecord
+    ROUTES_WEIGHTS = 13,    // таблица маршрутизатора V x V: веса, double
+    ROUTES_PREV_EDGES = 14, // таблица маршрутизатора V x V: последние рёбра, uint32_t
+};
+
+struct CoordinatesRecord {
+    double lat;
+    double lng;
+};
+
+struct DistanceRecord {
+    std::uint32_t from;
+    std::uint32_t to;
+    std::int32_t distance;
+};
+
+struct EdgeRecord {
+    std::uint32_t from;
+    std::uint32_t to;
+    double weight;
+};
+
+struct EdgeInfoRecord {
+    std::uint32_t id_bus;
+    std::int32_t stops_count;
+    std::uint32_t type;
+};
+
+// массив записей секции внутри отображения файла
+template <typename T>
+struct ArrayView {
+    const T* data = nullptr;
+    size_t size = 0;
+
+    const T* begin() const {
+        return data;
+    }
+    const T* end() const {
+        return data + size;
+    }
+    const T& operator[](size_t index) const {
+        return data[index];
+    }
+};
+
+// файл, отображённый в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& file_name);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* GetData() const;
+    size_t GetSize() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    // без mmap файл читается целиком
+    std::vector<char> buffer_;
+};
+
+class BaseWriter {
+public:
+    // данные копируются в писатель
+    void AddSection(SectionId id, std::string_view bytes);
+
+    template <typename T>
+    void AddArray(SectionId id, const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>, "Section records should be trivially copyable");
+        AddSection(id, std::string_view(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T)));
+    }
+
+    // данные не копируются и должны жить до WriteToFile (большие таблицы)
+    template <typename T>
+    void AddArrayView(SectionId id, const T* data, size_t size) {
+        static_assert(std::is_trivially_copyable_v<T>, "Section records should be trivially copyable");
+        sections_.push_back({id, {}, reinterpret_cast<const char*>(data), size * sizeof(T)});
+    }
+
+    bool WriteToFile(const std::string& file_name) const;
+
+private:
+    // данные секции - owned или, если задан, view
+    struct Section {
+        SectionId id;
+        std::string owned;
+        const char* view;
+        size_t size;
+    };
+
+    std::vector<Section> sections_;
+};
+
+class BaseReader {
+public:
+    // ошибки формата - исключения
+    explicit BaseReader(const std::string& file_name);
+
+    // начинается ли файл с сигнатуры плоской базы
+    static bool IsFlatBase(const std::string& file_name);
+
+    bool HasSection(SectionId id) const;
+    // номера секций в порядке файла
+    std::vector<SectionId> GetSectionIds() const;
+    std::string_view GetSection(SectionId id) const;
+
+    template <typename T>
+    ArrayView<T> GetArray(SectionId id) const {
+        static_assert(std::is_trivially_copyable_v<T>, "Section records should be trivially copyable");
+        const std::string_view bytes = GetSection(id);
+        if (bytes.size() % sizeof(T) != 0
+            || reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(T) != 0) {
+            throw std::runtime_error("Flat base section has wrong layout");
+        }
+        return {reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+
+    // отображение файла для данных, которые читаются из него и после загрузки
+    std::shared_ptr<const MappedFile> GetFile() const;
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    std::vector<std::pair<SectionId, std::string_view>> sections_;
+};
+
+}  // namespace flat
@@ -2,7 +2,9 @@
 
 #include "ranges.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <stdexcept>
 #include <vector>
 
 namespace graph {
@@ -17,6 +19,15 @@ struct Edge {
     Weight weight;
 };
 
+// дуги одной вершины в CSR-представлении: смежные вершины, веса и номера рёбер
+template <typename Weight>
+struct IncidentArcs {
+    const VertexId* vertices;
+    const Weight* weights;
+    const EdgeId* edge_ids;
+    size_t size;
+};
+
 template <typename Weight>
 class DirectedWeightedGraph {
 private:
@@ -26,6 +37,10 @@ private:
 public:
     DirectedWeightedGraph() = default;
     explicit DirectedWeightedGraph(size_t vertex_count);
+    // построение сразу в замороженном виде по готовому списку рёбер,
+    // removed_edges - отметки удалённых рёбер (пусто - удалённых нет)
+    DirectedWeightedGraph(size_t vertex_count, std::vector<Edge<Weight>> edges,
+                          std::vector<bool> removed_edges = {});
     EdgeId AddEdge(const Edge<Weight>& edge);
 
     size_t GetVertexCount() const;
@@ -34,35 +49,119 @@ public:
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
     void Reset();
     void SetVertexCount(size_t new_count);
-    
+    // добавление вершин без сброса рёбер, только для незамороженного графа
+    void AddVertices(size_t count);
+
+    // удаление ребра без перенумерации: номер остаётся за ребром, но в списки дуг
+    // оно больше не входит; только для незамороженного графа
+    void RemoveEdge(EdgeId edge_id);
+    bool IsEdgeRemoved(EdgeId edge_id) const;
+
+    // перевод в неизменяемое CSR-представление после окончания построения,
+    // списки инцидентности при этом освобождаются
+    void Freeze();
+    bool IsFrozen() const;
+    // возврат к изменяемому виду: списки инцидентности восстанавливаются по рёбрам
+    void Unfreeze();
+    // исходящие и входящие дуги вершины, только для замороженного графа
+    IncidentArcs<Weight> GetOutgoingArcs(VertexId vertex) const;
+    IncidentArcs<Weight> GetIncomingArcs(VertexId vertex) const;
 
 private:
+    // массивы CSR: дуги вершины v лежат в [offsets[v], offsets[v + 1])
+    struct CompressedArcs {
+        std::vector<size_t> offsets;
+        std::vector<VertexId> vertices;
+        std::vector<Weight> weights;
+        std::vector<EdgeId> edge_ids;
+
+        void Build(const std::vector<Edge<Weight>>& edges, const std::vector<bool>& removed_edges,
+                   size_t vertex_count, bool outgoing);
+        IncidentArcs<Weight> Get(VertexId vertex) const;
+    };
+
     std::vector<Edge<Weight>> edges_;
     std::vector<IncidenceList> incidence_lists_;
+    std::vector<bool> removed_edges_;
+    size_t vertex_count_ = 0;
+    bool frozen_ = false;
+    CompressedArcs outgoing_;
+    CompressedArcs incoming_;
 };
 
 template <typename Weight>
 DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
-    : incidence_lists_(vertex_count) {
+    : incidence_lists_(vertex_count)
+    , vertex_count_(vertex_count) {
+}
+
+template <typename Weight>
+DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count, std::vector<Edge<Weight>> edges,
+                                                     std::vector<bool> removed_edges)
+    : edges_(std::move(edges))
+    , removed_edges_(std::move(removed_edges))
+    , vertex_count_(vertex_count) {
+    if (removed_edges_.size() > edges_.size()) {
+        throw std::out_of_range("Removed edge is out of graph");
+    }
+    for (const auto& edge : edges_) {
+        if (edge.from >= vertex_count_ || edge.to >= vertex_count_) {
+            throw std::out_of_range("Edge vertex is out of graph");
+        }
+    }
+    Freeze();
 }
 
 template <typename Weight>
 EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
+    if (frozen_) {
+        throw std::logic_error("Graph is frozen");
+    }
+    incidence_lists_.at(edge.from).push_back(edges_.size());
     edges_.push_back(edge);
-    const EdgeId id = edges_.size() - 1;
-    incidence_lists_.at(edge.from).push_back(id);
-    return id;
+    return edges_.size() - 1;
 }
 
 template <typename Weight>
 size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-    return incidence_lists_.size();
+    return vertex_count_;
 }
 
 template <typename Weight>
 void DirectedWeightedGraph<Weight>::SetVertexCount(size_t new_count) {
     Reset();
     incidence_lists_.resize(new_count);
+    vertex_count_ = new_count;
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::AddVertices(size_t count) {
+    if (frozen_) {
+        throw std::logic_error("Graph is frozen");
+    }
+    vertex_count_ += count;
+    incidence_lists_.resize(vertex_count_);
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::RemoveEdge(EdgeId edge_id) {
+    if (frozen_) {
+        throw std::logic_error("Graph is frozen");
+    }
+    if (IsEdgeRemoved(edge_id)) {
+        return;
+    }
+    auto& incidence_list = incidence_lists_.at(edges_.at(edge_id).from);
+    incidence_list.erase(std::find(incidence_list.begin(), incidence_list.end(), edge_id));
+    if (removed_edges_.size() <= edge_id) {
+        removed_edges_.resize(edge_id + 1, false);
+    }
+    removed_edges_[edge_id] = true;
+}
+
+template <typename Weight>
+bool DirectedWeightedGraph<Weight>::IsEdgeRemoved(EdgeId edge_id) const {
+    return edge_id < removed_edges_.size() && removed_edges_[edge_id];
 }
 
 template <typename Weight>
@@ -78,6 +177,10 @@ const Edge<Weight>& DirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const
 template <typename Weight>
 typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
 DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+    if (frozen_) {
+        const auto begin = outgoing_.edge_ids.begin();
+        return IncidentEdgesRange(begin + outgoing_.offsets.at(vertex), begin + outgoing_.offsets.at(vertex + 1));
+    }
     return ranges::AsRange(incidence_lists_.at(vertex));
 }
 
@@ -85,6 +188,94 @@ template <typename Weight>
 void DirectedWeightedGraph<Weight>::Reset() {
     edges_.clear();
     incidence_lists_.clear();
+    removed_edges_.clear();
+    vertex_count_ = 0;
+    frozen_ = false;
+    outgoing_ = {};
+    incoming_ = {};
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::Freeze() {
+    if (frozen_) {
+        return;
+    }
+    outgoing_.Build(edges_, removed_edges_, vertex_count_, true);
+    incoming_.Build(edges_, removed_edges_, vertex_count_, false);
+    incidence_lists_.clear();
+    incidence_lists_.shrink_to_fit();
+    frozen_ = true;
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::Unfreeze() {
+    if (!frozen_) {
+        return;
+    }
+    // исходящие дуги CSR уже разложены по вершинам в порядке добавления рёбер
+    incidence_lists_.assign(vertex_count_, {});
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        const auto arcs = outgoing_.Get(vertex);
+        incidence_lists_[vertex].assign(arcs.edge_ids, arcs.edge_ids + arcs.size);
+    }
+    outgoing_ = {};
+    incoming_ = {};
+    frozen_ = false;
+}
+
+template <typename Weight>
+bool DirectedWeightedGraph<Weight>::IsFrozen() const {
+    return frozen_;
+}
+
+template <typename Weight>
+IncidentArcs<Weight> DirectedWeightedGraph<Weight>::GetOutgoingArcs(VertexId vertex) const {
+    return outgoing_.Get(vertex);
+}
+
+template <typename Weight>
+IncidentArcs<Weight> DirectedWeightedGraph<Weight>::GetIncomingArcs(VertexId vertex) const {
+    return incoming_.Get(vertex);
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::CompressedArcs::Build(const std::vector<Edge<Weight>>& edges,
+                                                          const std::vector<bool>& removed_edges,
+                                                          size_t vertex_count, bool outgoing) {
+    const auto is_removed = [&removed_edges](EdgeId edge_id) {
+        return edge_id < removed_edges.size() && removed_edges[edge_id];
+    };
+    // сортировка подсчётом: внутри вершины рёбра идут в порядке добавления
+    offsets.assign(vertex_count + 1, 0);
+    for (EdgeId edge_id = 0; edge_id < edges.size(); ++edge_id) {
+        if (!is_removed(edge_id)) {
+            ++offsets[(outgoing ? edges[edge_id].from : edges[edge_id].to) + 1];
+        }
+    }
+    for (size_t vertex = 0; vertex < vertex_count; ++vertex) {
+        offsets[vertex + 1] += offsets[vertex];
+    }
+
+    vertices.resize(offsets[vertex_count]);
+    weights.resize(offsets[vertex_count]);
+    edge_ids.resize(offsets[vertex_count]);
+    std::vector<size_t> positions(offsets.begin(), offsets.end() - 1);
+    for (EdgeId edge_id = 0; edge_id < edges.size(); ++edge_id) {
+        if (is_removed(edge_id)) {
+            continue;
+        }
+        const auto& edge = edges[edge_id];
+        const size_t position = positions[outgoing ? edge.from : edge.to]++;
+        vertices[position] = outgoing ? edge.to : edge.from;
+        weights[position] = edge.weight;
+        edge_ids[position] = edge_id;
+    }
+}
+
+template <typename Weight>
+IncidentArcs<Weight> DirectedWeightedGraph<Weight>::CompressedArcs::Get(VertexId vertex) const {
+    const size_t begin = offsets.at(vertex);
+    return {vertices.data() + begin, weights.data() + begin, edge_ids.data() + begin, offsets[vertex + 1] - begin};
 }
 
 }  // namespace graph
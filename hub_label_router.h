@@ -0,0 +1,381 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <transport_router.pb.h>
+
+namespace graph {
+
+// маршрутизатор с 2-hop метками (pruned landmark labeling): у каждой вершины
+// отсортированные по хабам списки (хаб, вес, ребро) путей до хабов и от хабов,
+// запрос - слияние двух коротких списков и раскрутка пути по меткам
+template <typename Weight>
+class HubLabelRouter: public IRouter<Weight> {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using typename IRouter<Weight>::RouteInfo;
+
+    explicit HubLabelRouter(const Graph& graph);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const override;
+    // метки "от хабов" всех вершин to раскладываются по корзинам хабов,
+    // строка для вершины from - проход по её метке "до хабов" и корзинам её хабов
+    std::vector<std::vector<std::optional<Weight>>> BuildWeightMatrix(const std::vector<VertexId>& from,
+                                                                      const std::vector<VertexId>& to) const override;
+
+    void Serialize(transport_router_serialize::TransportRouter &serialData) const override;
+    void Deserialize(const transport_router_serialize::TransportRouter &serialData) override;
+
+    // метки с отсечением не обновляются по частям, после изменения графа строятся заново
+    void UpdateRoutes(const std::vector<EdgeId>& added_edges, const std::vector<EdgeId>& removed_edges) override;
+
+private:
+    // хаб задаётся рангом: чем меньше ранг, тем раньше вершина стала хабом
+    using HubId = std::uint32_t;
+    using LabelEdgeId = std::uint32_t;
+
+    struct LabelEntry {
+        HubId hub;
+        Weight weight;
+        LabelEdgeId edge;
+    };
+
+    // метки всех вершин одним куском: записи вершины v лежат в [offsets[v], offsets[v + 1]),
+    // по возрастанию хаба; edge - первое ребро пути до хаба (метки "до хабов")
+    // или последнее ребро пути от хаба (метки "от хабов"), у самого хаба - NO_EDGE
+    struct Labels {
+        std::vector<size_t> offsets;
+        std::vector<HubId> hubs;
+        std::vector<Weight> weights;
+        std::vector<LabelEdgeId> edges;
+
+        void Assign(const std::vector<std::vector<LabelEntry>>& entries);
+        // запись о хабе в метке вершины, если она есть
+        std::optional<size_t> Find(VertexId vertex, HubId hub) const;
+    };
+
+    using QueueItem = std::pair<Weight, VertexId>;
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>>;
+
+    // рабочие массивы построения, общие для всех поисков
+    struct BuildBuffers {
+        std::vector<Weight> hub_weights;
+        std::vector<Weight> weights;
+        std::vector<LabelEdgeId> edges;
+        std::vector<VertexId> visited;
+    };
+
+    void CheckGraph() const;
+    void BuildLabels();
+    // поиск из хаба с отсечением вершин, путь до которых уже покрыт прежними хабами:
+    // прямой поиск дополняет метки "от хабов", обратный - метки "до хабов"
+    void RunPrunedSearch(HubId hub, bool forward, const std::vector<LabelEntry>& hub_label,
+                         std::vector<std::vector<LabelEntry>>& labels, BuildBuffers& buffers) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+    static constexpr Weight UNREACHABLE_WEIGHT = std::numeric_limits<Weight>::max();
+    static constexpr LabelEdgeId NO_EDGE = std::numeric_limits<LabelEdgeId>::max();
+    const Graph& graph_;
+    // вершина каждого хаба
+    std::vector<VertexId> hub_vertices_;
+    Labels out_labels_;
+    Labels in_labels_;
+};
+
+template <typename Weight>
+void HubLabelRouter<Weight>::Labels::Assign(const std::vector<std::vector<LabelEntry>>& entries) {
+    offsets.assign(1, 0);
+    hubs.clear();
+    weights.clear();
+    edges.clear();
+    for (const auto& label : entries) {
+        for (const auto& entry : label) {
+            hubs.push_back(entry.hub);
+            weights.push_back(entry.weight);
+            edges.push_back(entry.edge);
+        }
+        offsets.push_back(hubs.size());
+    }
+}
+
+template <typename Weight>
+std::optional<size_t> HubLabelRouter<Weight>::Labels::Find(VertexId vertex, HubId hub) const {
+    const auto begin = hubs.begin() + offsets[vertex];
+    const auto end = hubs.begin() + offsets[vertex + 1];
+    const auto it = std::lower_bound(begin, end, hub);
+    if (it == end || *it != hub) {
+        return std::nullopt;
+    }
+    return it - hubs.begin();
+}
+
+template <typename Weight>
+HubLabelRouter<Weight>::HubLabelRouter(const Graph& graph)
+    : graph_(graph)
+{
+    CheckGraph();
+    BuildLabels();
+}
+
+template <typename Weight>
+void HubLabelRouter<Weight>::CheckGraph() const {
+    if (graph_.GetVertexCount() > 0 && !graph_.IsFrozen()) {
+        throw std::logic_error("Graph should be frozen before routing");
+    }
+    const size_t edge_count = graph_.GetEdgeCount();
+    if (edge_count >= NO_EDGE) {
+        throw std::length_error("Too many edges for hub labels");
+    }
+    for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+        if (graph_.GetEdge(edge_id).weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+    }
+}
+
+template <typename Weight>
+void HubLabelRouter<Weight>::BuildLabels() {
+    const size_t vertex_count = graph_.GetVertexCount();
+    // первыми хабами становятся вершины с наибольшим числом дуг:
+    // через пересадочные узлы проходит больше всего кратчайших путей
+    std::vector<size_t> degrees(vertex_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        degrees[vertex] = graph_.GetOutgoingArcs(vertex).size + graph_.GetIncomingArcs(vertex).size;
+    }
+    hub_vertices_.resize(vertex_count);
+    std::iota(hub_vertices_.begin(), hub_vertices_.end(), VertexId{0});
+    std::stable_sort(hub_vertices_.begin(), hub_vertices_.end(), [&degrees](VertexId lhs, VertexId rhs) {
+        return degrees[lhs] > degrees[rhs];
+    });
+
+    std::vector<std::vector<LabelEntry>> out_labels(vertex_count);
+    std::vector<std::vector<LabelEntry>> in_labels(vertex_count);
+    BuildBuffers buffers{std::vector<Weight>(vertex_count, UNREACHABLE_WEIGHT),
+                         std::vector<Weight>(vertex_count, UNREACHABLE_WEIGHT),
+                         std::vector<LabelEdgeId>(vertex_count, NO_EDGE), {}};
+    // хабы добавляются по возрастанию ранга, поэтому метки сразу отсортированы
+    for (HubId hub = 0; hub < vertex_count; ++hub) {
+        const VertexId hub_vertex = hub_vertices_[hub];
+        RunPrunedSearch(hub, true, out_labels[hub_vertex], in_labels, buffers);
+        RunPrunedSearch(hub, false, in_labels[hub_vertex], out_labels, buffers);
+    }
+    out_labels_.Assign(out_labels);
+    in_labels_.Assign(in_labels);
+}
+
+template <typename Weight>
+void HubLabelRouter<Weight>::RunPrunedSearch(HubId hub, bool forward, const std::vector<LabelEntry>& hub_label,
+                                             std::vector<std::vector<LabelEntry>>& labels,
+                                             BuildBuffers& buffers) const {
+    // веса до хабов (от хабов) самого хаба - для проверки покрытия за один проход по метке вершины
+    for (const auto& entry : hub_label) {
+        buffers.hub_weights[entry.hub] = entry.weight;
+    }
+    const VertexId hub_vertex = hub_vertices_[hub];
+    Queue queue;
+    buffers.weights[hub_vertex] = ZERO_WEIGHT;
+    buffers.visited.push_back(hub_vertex);
+    queue.push({ZERO_WEIGHT, hub_vertex});
+
+    while (!queue.empty()) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (weight > buffers.weights[vertex]) {
+            continue;
+        }
+        auto& label = labels[vertex];
+        const bool covered = std::any_of(label.begin(), label.end(), [&buffers, weight = weight](const LabelEntry& entry) {
+            const Weight hub_weight = buffers.hub_weights[entry.hub];
+            return hub_weight != UNREACHABLE_WEIGHT && hub_weight + entry.weight <= weight;
+        });
+        if (covered) {
+            continue;
+        }
+        label.push_back({hub, weight, buffers.edges[vertex]});
+
+        const auto arcs = forward ? graph_.GetOutgoingArcs(vertex) : graph_.GetIncomingArcs(vertex);
+        for (size_t i = 0; i < arcs.size; ++i) {
+            const VertexId next = arcs.vertices[i];
+            const Weight candidate_weight = weight + arcs.weights[i];
+            if (candidate_weight < buffers.weights[next]) {
+                if (buffers.weights[next] == UNREACHABLE_WEIGHT) {
+                    buffers.visited.push_back(next);
+                }
+                buffers.weights[next] = candidate_weight;
+                buffers.edges[next] = static_cast<LabelEdgeId>(arcs.edge_ids[i]);
+                queue.push({candidate_weight, next});
+            }
+        }
+    }
+
+    for (const VertexId vertex : buffers.visited) {
+        buffers.weights[vertex] = UNREACHABLE_WEIGHT;
+        buffers.edges[vertex] = NO_EDGE;
+    }
+    buffers.visited.clear();
+    for (const auto& entry : hub_label) {
+        buffers.hub_weights[entry.hub] = UNREACHABLE_WEIGHT;
+    }
+}
+
+template <typename Weight>
+std::optional<typename HubLabelRouter<Weight>::RouteInfo> HubLabelRouter<Weight>::BuildRoute(VertexId from,
+                                                                                             VertexId to) const {
+    const size_t vertex_count = hub_vertices_.size();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex is out of hub labels");
+    }
+    // лучший общий хаб: слияние меток from "до хабов" и to "от хабов"
+    Weight best_weight = UNREACHABLE_WEIGHT;
+    size_t best_out = 0;
+    size_t best_in = 0;
+    size_t out_index = out_labels_.offsets[from];
+    size_t in_index = in_labels_.offsets[to];
+    const size_t out_end = out_labels_.offsets[from + 1];
+    const size_t in_end = in_labels_.offsets[to + 1];
+    while (out_index < out_end && in_index < in_end) {
+        const HubId out_hub = out_labels_.hubs[out_index];
+        const HubId in_hub = in_labels_.hubs[in_index];
+        if (out_hub < in_hub) {
+            ++out_index;
+        } else if (in_hub < out_hub) {
+            ++in_index;
+        } else {
+            const Weight weight = out_labels_.weights[out_index] + in_labels_.weights[in_index];
+            if (weight < best_weight) {
+                best_weight = weight;
+                best_out = out_index;
+                best_in = in_index;
+            }
+            ++out_index;
+            ++in_index;
+        }
+    }
+    if (best_weight == UNREACHABLE_WEIGHT) {
+        return std::nullopt;
+    }
+
+    // пути до хаба и от хаба идут по деревьям поиска из хаба: предок вершины
+    // в дереве был раскрыт, а значит, тоже получил метку этого хаба
+    const HubId hub = out_labels_.hubs[best_out];
+    std::vector<EdgeId> edges;
+    for (LabelEdgeId edge_id = out_labels_.edges[best_out]; edge_id != NO_EDGE;) {
+        edges.push_back(edge_id);
+        edge_id = out_labels_.edges[*out_labels_.Find(graph_.GetEdge(edge_id).to, hub)];
+    }
+    std::vector<EdgeId> edges_from_hub;
+    for (LabelEdgeId edge_id = in_labels_.edges[best_in]; edge_id != NO_EDGE;) {
+        edges_from_hub.push_back(edge_id);
+        edge_id = in_labels_.edges[*in_labels_.Find(graph_.GetEdge(edge_id).from, hub)];
+    }
+    edges.insert(edges.end(), edges_from_hub.rbegin(), edges_from_hub.rend());
+
+    return RouteInfo{best_weight, std::move(edges)};
+}
+
+template <typename Weight>
+std::vector<std::vector<std::optional<Weight>>> HubLabelRouter<Weight>::BuildWeightMatrix(const std::vector<VertexId>& from,
+                                                                                          const std::vector<VertexId>& to) const {
+    const size_t vertex_count = hub_vertices_.size();
+    // корзина хаба: номера столбцов и веса путей от хаба до их вершин
+    std::unordered_map<HubId, std::vector<std::pair<size_t, Weight>>> buckets;
+    for (size_t column = 0; column < to.size(); ++column) {
+        if (to[column] >= vertex_count) {
+            throw std::out_of_range("Vertex is out of hub labels");
+        }
+        for (size_t index = in_labels_.offsets[to[column]]; index < in_labels_.offsets[to[column] + 1]; ++index) {
+            buckets[in_labels_.hubs[index]].emplace_back(column, in_labels_.weights[index]);
+        }
+    }
+
+    std::vector<std::vector<std::optional<Weight>>> matrix(from.size());
+    std::vector<Weight> row(to.size());
+    for (size_t i = 0; i < from.size(); ++i) {
+        if (from[i] >= vertex_count) {
+            throw std::out_of_range("Vertex is out of hub labels");
+        }
+        std::fill(row.begin(), row.end(), UNREACHABLE_WEIGHT);
+        for (size_t index = out_labels_.offsets[from[i]]; index < out_labels_.offsets[from[i] + 1]; ++index) {
+            const auto bucket = buckets.find(out_labels_.hubs[index]);
+            if (bucket == buckets.end()) {
+                continue;
+            }
+            for (const auto& [column, weight] : bucket->second) {
+                row[column] = std::min(row[column], out_labels_.weights[index] + weight);
+            }
+        }
+        matrix[i].reserve(to.size());
+        for (const Weight weight : row) {
+            matrix[i].push_back(weight != UNREACHABLE_WEIGHT ? std::optional<Weight>(weight) : std::nullopt);
+        }
+    }
+    return matrix;
+}
+
+template <typename Weight>
+void HubLabelRouter<Weight>::UpdateRoutes(const std::vector<EdgeId>& /*added_edges*/,
+                                          const std::vector<EdgeId>& /*removed_edges*/) {
+    CheckGraph();
+    BuildLabels();
+}
+
+namespace detail {
+
+template <typename Labels, typename LabelsProto>
+void SerializeHubLabels(const Labels& labels, LabelsProto& labels_proto) {
+    labels_proto.mutable_offsets()->Add(labels.offsets.begin(), labels.offsets.end());
+    labels_proto.mutable_hubs()->Add(labels.hubs.begin(), labels.hubs.end());
+    labels_proto.mutable_weights()->Add(labels.weights.begin(), labels.weights.end());
+    labels_proto.mutable_edges()->Add(labels.edges.begin(), labels.edges.end());
+}
+
+template <typename Labels, typename LabelsProto>
+void DeserializeHubLabels(const LabelsProto& labels_proto, size_t vertex_count, Labels& labels) {
+    if (static_cast<size_t>(labels_proto.offsets_size()) != vertex_count + 1
+        || labels_proto.hubs_size() != labels_proto.weights_size()
+        || labels_proto.hubs_size() != labels_proto.edges_size()
+        || labels_proto.offsets(labels_proto.offsets_size() - 1) != static_cast<uint64_t>(labels_proto.hubs_size())) {
+        throw std::invalid_argument("Hub labels are inconsistent");
+    }
+    labels.offsets.assign(labels_proto.offsets().begin(), labels_proto.offsets().end());
+    labels.hubs.assign(labels_proto.hubs().begin(), labels_proto.hubs().end());
+    labels.weights.assign(labels_proto.weights().begin(), labels_proto.weights().end());
+    labels.edges.assign(labels_proto.edges().begin(), labels_proto.edges().end());
+}
+
+}  // namespace detail
+
+template<>
+inline void HubLabelRouter<double>::Serialize(transport_router_serialize::TransportRouter &serialData) const {
+    auto &labels_proto = *serialData.mutable_hub_labels();
+    labels_proto.mutable_hub_vertices()->Add(hub_vertices_.begin(), hub_vertices_.end());
+    detail::SerializeHubLabels(out_labels_, *labels_proto.mutable_out_labels());
+    detail::SerializeHubLabels(in_labels_, *labels_proto.mutable_in_labels());
+}
+
+template<>
+inline void HubLabelRouter<double>::Deserialize(const transport_router_serialize::TransportRouter &serialData) {
+    CheckGraph();
+    const auto &labels_proto = serialData.hub_labels();
+    if (static_cast<size_t>(labels_proto.hub_vertices_size()) != graph_.GetVertexCount()) {
+        throw std::invalid_argument("Hub labels do not match graph");
+    }
+    hub_vertices_.assign(labels_proto.hub_vertices().begin(), labels_proto.hub_vertices().end());
+    detail::DeserializeHubLabels(labels_proto.out_labels(), hub_vertices_.size(), out_labels_);
+    detail::DeserializeHubLabels(labels_proto.in_labels(), hub_vertices_.size(), in_labels_);
+}
+
+}  // namespace graph
@@ -1,5 +1,6 @@
 #include "json.h"
 
+#include <algorithm>
 #include <iterator>
 
 namespace json {
@@ -226,15 +227,26 @@ struct PrintContext {
     std::ostream& out;
     int indent_step = 4;
     int indent = 0;
+    // в одну строку: без переводов строк и отступов
+    bool compact = false;
 
     void PrintIndent() const {
+        if (compact) {
+            return;
+        }
         for (int i = 0; i < indent; ++i) {
             out.put(' ');
         }
     }
 
+    void PrintNewLine() const {
+        if (!compact) {
+            out.put('\n');
+        }
+    }
+
     PrintContext Indented() const {
-        return {out, indent_step, indent_step + indent};
+        return {out, indent_step, indent_step + indent, compact};
     }
 };
 
@@ -291,19 +303,38 @@ void PrintValue<bool>(const bool& value, const PrintContext& ctx) {
 template <>
 void PrintValue<Array>(const Array& nodes, const PrintContext& ctx) {
     std::ostream& out = ctx.out;
-    out << "[\n"sv;
+    // массивы чисел (строки матриц) выводятся в одну строку
+    const bool is_numeric = !nodes.empty() && std::all_of(nodes.begin(), nodes.end(), [](const Node& node) {
+        return node.IsDouble() || node.IsNull();
+    });
+    if (is_numeric) {
+        out.put('[');
+        bool first = true;
+        for (const Node& node : nodes) {
+            if (!first) {
+                out << ", "sv;
+            }
+            first = false;
+            PrintNode(node, ctx);
+        }
+        out.put(']');
+        return;
+    }
+    out.put('[');
+    ctx.PrintNewLine();
     bool first = true;
     auto inner_ctx = ctx.Indented();
     for (const Node& node : nodes) {
         if (first) {
             first = false;
         } else {
-            out << ",\n"sv;
+            out.put(',');
+            ctx.PrintNewLine();
         }
         inner_ctx.PrintIndent();
         PrintNode(node, inner_ctx);
     }
-    out.put('\n');
+    ctx.PrintNewLine();
     ctx.PrintIndent();
     out.put(']');
 }
@@ -311,21 +342,23 @@ void PrintValue<Array>(const Array& nodes, const PrintContext& ctx) {
 template <>
 void PrintValue<Dict>(const Dict& nodes, const PrintContext& ctx) {
     std::ostream& out = ctx.out;
-    out << "{\n"sv;
+    out.put('{');
+    ctx.PrintNewLine();
     bool first = true;
     auto inner_ctx = ctx.Indented();
     for (const auto& [key, node] : nodes) {
         if (first) {
             first = false;
         } else {
-            out << ",\n"sv;
+            out.put(',');
+            ctx.PrintNewLine();
         }
         inner_ctx.PrintIndent();
         PrintString(key, ctx.out);
         out << ": "sv;
         PrintNode(node, inner_ctx);
     }
-    out.put('\n');
+    ctx.PrintNewLine();
     ctx.PrintIndent();
     out.put('}');
 }
@@ -348,4 +381,8 @@ void Print(const Document& doc, std::ostream& output) {
     PrintNode(doc.GetRoot(), PrintContext{output});
 }
 
+void PrintCompact(const Document& doc, std::ostream& output) {
+    PrintNode(doc.GetRoot(), PrintContext{output, 0, 0, true});
+}
+
 }  // namespace json
\ No newline at end of file
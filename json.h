@@ -141,4 +141,7 @@ Document Load(std::istream& input);
 
 void Print(const Document& doc, std::ostream& output);
 
+// вывод в одну строку (построчный обмен документами)
+void PrintCompact(const Document& doc, std::ostream& output);
+
 }  // namespace json
\ No newline at end of file
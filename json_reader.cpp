@@ -1,5 +1,8 @@
 #include <algorithm>
+#include <map>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <iostream>
 
 #include "json_reader.h"
@@ -29,6 +32,8 @@ void ITransportCatalogeReader::SaveDataToCataloge(TransportCatalogeHandler &cata
             catalogue_handler.AddDistance(rec.Name, item.first, item.second);
         }
     }    
+    
+    catalogue_handler.SetTimetables(std::move(input.Timetables));
 }    
     
 void ITransportCatalogeReader::RunQuery(TransportCatalogeHandler &catalogue_handler) {
@@ -48,6 +53,31 @@ domain::BusRoute JsonReader::ParseBus(const json::Dict &dict) {
     return result;
 }
     
+std::optional<domain::BusTimetable> JsonReader::ParseTimetable(const json::Dict &dict) {
+    domain::BusTimetable result;
+    result.Number = dict.at("name").AsString();
+    if (dict.count("departures"s) > 0) {
+        for (auto &node:dict.at("departures"s).AsArray()) {
+            result.Departures.push_back(node.AsDouble());
+        }
+    } else if (dict.count("headway"s) > 0) {
+        // рейсы с постоянным интервалом от первого до последнего отправления
+        const auto &headway = dict.at("headway"s).AsDict();
+        double first = headway.at("first_departure"s).AsDouble();
+        double last = headway.at("last_departure"s).AsDouble();
+        double interval = headway.at("interval"s).AsDouble();
+        if (interval <= 0) {
+            throw std::invalid_argument("Headway interval should be positive: "s + result.Number);
+        }
+        for (double departure = first; departure <= last; departure += interval) {
+            result.Departures.push_back(departure);
+        }
+    } else {
+        return std::nullopt;
+    }
+    return result;
+}
+    
 domain::RoutesStop JsonReader::ParseStop(const json::Dict &dict) {
     domain::RoutesStop result;
     
@@ -73,6 +103,9 @@ domain::InputData JsonReader::ReadInputQuery() {
             result.ListStops.push_back(ParseStop(item_dict));
         } else if (item_dict.at("type"s).AsString() == "Bus"s) {
             result.ListBuses.push_back(ParseBus(item_dict));
+            if (auto timetable = ParseTimetable(item_dict)) {
+                result.Timetables.push_back(std::move(*timetable));
+            }
         }
     }
     
@@ -89,20 +122,204 @@ void JsonReader::ParseQuery(TransportCatalogeHandler &catalogue_handler, const j
     } else if (dict.at("type"s).AsString() == "Map"s) {
         SaveMapRender(requestId, catalogue_handler.RenderMap());
     } else if (dict.at("type"s).AsString() == "Route"s) {
-        SaveRouterData(requestId, catalogue_handler.GetRoute(dict.at("from"s).AsString(), dict.at("to"s).AsString()));
+        SaveRouterData(requestId, catalogue_handler.GetRoute(dict.at("from"s).AsString(), dict.at("to"s).AsString(), GetMaxTransfers(dict), GetDepartureTime(dict)));
+    } else if (dict.at("type"s).AsString() == "RouteMatrix"s) {
+        SaveRouteMatrix(requestId, catalogue_handler.GetRouteMatrix(GetStopNames(dict.at("from"s)), GetStopNames(dict.at("to"s)), GetMaxTransfers(dict)));
+    } else if (dict.at("type"s).AsString() == "Isochrone"s) {
+        SaveIsochrone(requestId, catalogue_handler.GetIsochrone(dict.at("from"s).AsString(), dict.at("max_time"s).AsDouble(), GetMaxTransfers(dict)));
+    }
+}
+    
+std::optional<int> JsonReader::GetMaxTransfers(const json::Dict &dict) const {
+    if (dict.count("max_transfers"s) > 0) {
+        return dict.at("max_transfers"s).AsInt();
+    }
+    return std::nullopt;
+}
+    
+std::vector<std::string> JsonReader::GetStopNames(const json::Node &names) const {
+    std::vector<std::string> result;
+    for (const auto &name:names.AsArray()) {
+        result.push_back(name.AsString());
+    }
+    return result;
+}
+    
+std::optional<double> JsonReader::GetDepartureTime(const json::Dict &dict) const {
+    if (dict.count("departure_time"s) > 0) {
+        return dict.at("departure_time"s).AsDouble();
+    }
+    return std::nullopt;
+}
+    
+bool JsonReader::IsBatchRouting() const {
+    const auto &root = doc_.GetRoot().AsDict();
+    if (root.count("process_settings"s) == 0) {
+        return false;
+    }
+    const auto &settings = root.at("process_settings"s).AsDict();
+    return settings.count("batch_routing"s) > 0 && settings.at("batch_routing"s).AsBool();
+}
+    
+// минимальное число запросов из одной остановки, при котором строится общее дерево
+static const size_t MIN_BATCH_ROUTES = 4;
+    
+std::vector<std::optional<json::Dict>> JsonReader::BatchRoutes(TransportCatalogeHandler &catalogue_handler, const json::Array &requests,
+                                                               parallel::ThreadPool *pool) const {
+    // группы запросов с общими отправлением и ограничением пересадок
+    std::map<std::pair<std::string, std::optional<int>>, std::vector<size_t>> groups;
+    for (size_t i = 0; i < requests.size(); i++) {
+        const auto &dict = requests[i].AsDict();
+        // запросы по расписанию зависят от времени и решаются по одному
+        if (dict.at("type"s).AsString() == "Route"s && dict.count("departure_time"s) == 0) {
+            groups[{dict.at("from"s).AsString(), GetMaxTransfers(dict)}].push_back(i);
+        }
+    }
+    
+    std::vector<const std::pair<const std::pair<std::string, std::optional<int>>, std::vector<size_t>>*> batches;
+    for (const auto &group : groups) {
+        // несколько запросов быстрее решить обычным поиском между парами остановок
+        if (group.second.size() >= MIN_BATCH_ROUTES) {
+            batches.push_back(&group);
+        }
+    }
+    
+    std::vector<std::optional<json::Dict>> result(requests.size());
+    auto solve = [&](size_t batch) {
+        const auto &[key, positions] = *batches[batch];
+        std::vector<std::string> destinations;
+        destinations.reserve(positions.size());
+        for (size_t position : positions) {
+            destinations.push_back(requests[position].AsDict().at("to"s).AsString());
+        }
+        auto routes = catalogue_handler.GetRoutes(key.first, destinations, key.second);
+        for (size_t i = 0; i < positions.size(); i++) {
+            result[positions[i]] = std::move(routes[i]);
+        }
+    };
+    if (pool) {
+        pool->ParallelFor(batches.size(), solve);
+    } else {
+        for (size_t batch = 0; batch < batches.size(); batch++) {
+            solve(batch);
+        }
+    }
+    return result;
+}
+    
+json::Node JsonReader::AnswerQuery(TransportCatalogeHandler &catalogue_handler, const json::Dict &dict) const {
+    int requestId = dict.at("id"s).AsInt();
+    if (dict.at("type"s).AsString() == "Bus"s) {
+        return GetJsonBusInfo(requestId, catalogue_handler.GetBusInfo(dict.at("name").AsString()));
+    } else if (dict.at("type"s).AsString() == "Stop"s) {
+        return GetJsonStopInfo(requestId, catalogue_handler.GetStopInfo(dict.at("name").AsString()));
+    } else if (dict.at("type"s).AsString() == "Map"s) {
+        return GetJsonMapRender(requestId, catalogue_handler.RenderMap());
+    } else if (dict.at("type"s).AsString() == "Route"s) {
+        return GetJsonRouterData(requestId, catalogue_handler.GetRoute(dict.at("from"s).AsString(), dict.at("to"s).AsString(), GetMaxTransfers(dict), GetDepartureTime(dict)));
+    } else if (dict.at("type"s).AsString() == "RouteMatrix"s) {
+        return GetJsonRouteMatrix(requestId, catalogue_handler.GetRouteMatrix(GetStopNames(dict.at("from"s)), GetStopNames(dict.at("to"s)), GetMaxTransfers(dict)));
+    } else if (dict.at("type"s).AsString() == "Isochrone"s) {
+        return GetJsonIsochrone(requestId, catalogue_handler.GetIsochrone(dict.at("from"s).AsString(), dict.at("max_time"s).AsDouble(), GetMaxTransfers(dict)));
+    }
+    return nullptr;
+}
+    
+bool JsonReader::IsSearchStats() const {
+    const auto &root = doc_.GetRoot().AsDict();
+    if (root.count("process_settings"s) == 0) {
+        return false;
+    }
+    const auto &settings = root.at("process_settings"s).AsDict();
+    return settings.count("search_stats"s) > 0 && settings.at("search_stats"s).AsBool();
+}
+    
+void JsonReader::PrintStats(const TransportCatalogeHandler &catalogue_handler, std::ostream &out) const {
+    if (!IsSearchStats()) {
+        return;
+    }
+    const auto search = catalogue_handler.GetSearchStats();
+    const auto cache = catalogue_handler.GetRouteCacheStats();
+    out << "searches: "s << search.searches << ", settled vertices: "s << search.settled_vertices;
+    if (search.searches > 0) {
+        out << " ("s << search.settled_vertices / search.searches << " per search)"s;
+    }
+    // те же поиски без эвристики - только у A*
+    if (search.baseline_settled_vertices > 0) {
+        out << ", without heuristic: "s << search.baseline_settled_vertices
+            << " ("s << search.baseline_settled_vertices / search.searches << " per search)"s;
+    }
+    out << "\nroute cache hits: "s << cache.hits << ", misses: "s << cache.misses << std::endl;
+}
+    
+std::optional<size_t> JsonReader::GetProcessThreads() const {
+    const auto &root = doc_.GetRoot().AsDict();
+    if (root.count("process_settings"s) == 0) {
+        return std::nullopt;
     }
+    const auto &settings = root.at("process_settings"s).AsDict();
+    if (settings.count("threads"s) == 0) {
+        return std::nullopt;
+    }
+    const int threads = settings.at("threads"s).AsInt();
+    if (threads < 0) {
+        throw std::invalid_argument("Process threads should not be negative: "s + std::to_string(threads));
+    }
+    return static_cast<size_t>(threads);
 }
     
 void JsonReader::ReadOutputQuery(TransportCatalogeHandler &catalogue_handler) {
     if (doc_.GetRoot().AsDict().count("stat_requests") == 0) {
         return;
     }
-    for (auto &item:doc_.GetRoot().AsDict().at("stat_requests").AsArray()) {
-        ParseQuery(catalogue_handler, item.AsDict());
+    const auto &requests = doc_.GetRoot().AsDict().at("stat_requests").AsArray();
+    catalogue_handler.SetBaselineSearchStats(IsSearchStats());
+    const auto threads = GetProcessThreads();
+    if (!IsBatchRouting() && !threads) {
+        for (auto &item:requests) {
+            ParseQuery(catalogue_handler, item.AsDict());
+        }
+        return;
+    }
+    
+    std::unique_ptr<parallel::ThreadPool> pool;
+    if (threads) {
+        pool = std::make_unique<parallel::ThreadPool>(*threads);
+    }
+    
+    // маршруты считаются заранее, ответы выводятся в исходном порядке запросов
+    std::vector<std::optional<json::Dict>> routes(requests.size());
+    if (IsBatchRouting()) {
+        routes = BatchRoutes(catalogue_handler, requests, pool.get());
+    }
+    if (!pool) {
+        for (size_t i = 0; i < requests.size(); i++) {
+            if (routes[i]) {
+                SaveRouterData(requests[i].AsDict().at("id"s).AsInt(), std::move(*routes[i]));
+            } else {
+                ParseQuery(catalogue_handler, requests[i].AsDict());
+            }
+        }
+        return;
+    }
+    
+    // запросы только читают справочник и маршрутизатор, ответы раскладываются по своим местам
+    std::vector<json::Node> answers(requests.size());
+    pool->ParallelFor(requests.size(), [&](size_t i) {
+        if (routes[i]) {
+            answers[i] = GetJsonRouterData(requests[i].AsDict().at("id"s).AsInt(), std::move(*routes[i]));
+        } else {
+            answers[i] = AnswerQuery(catalogue_handler, requests[i].AsDict());
+        }
+    });
+    for (auto &answer:answers) {
+        if (!answer.IsNull()) {
+            result_.push_back(std::move(answer));
+        }
     }
 }
 
-json::Node JsonReader::GetJsonBusInfo(int id, const domain::BusInfo &bus) {
+json::Node JsonReader::GetJsonBusInfo(int id, const domain::BusInfo &bus) const {
     if (bus.CountStop < 0) {
         return GetErrorMessage(id);
     } else {
@@ -117,7 +334,7 @@ json::Node JsonReader::GetJsonBusInfo(int id, const domain::BusInfo &bus) {
     }
 }
 
-json::Node JsonReader::GetJsonStopInfo(int id, const domain::StopInfo &stop) {
+json::Node JsonReader::GetJsonStopInfo(int id, const domain::StopInfo &stop) const {
     if (!stop.IsExist) {
         return GetErrorMessage(id);
     }
@@ -143,29 +360,85 @@ void JsonReader::SaveStopInfo(int id, const domain::StopInfo &stop) {
 }
     
 void JsonReader::SaveMapRender(int id, string raw_data) {
-    json::Dict dict = json::Builder{}
+    result_.push_back(GetJsonMapRender(id, std::move(raw_data)));
+}
+    
+void JsonReader::SaveRouterData(int id, json::Dict raw_data) {
+    result_.push_back(GetJsonRouterData(id, std::move(raw_data)));
+}    
+    
+void JsonReader::SaveRouteMatrix(int id, const TransportRouter::RouteMatrix &matrix) {
+    result_.push_back(GetJsonRouteMatrix(id, matrix));
+}
+    
+void JsonReader::SaveIsochrone(int id, const std::optional<TransportRouter::Isochrone> &isochrone) {
+    result_.push_back(GetJsonIsochrone(id, isochrone));
+}
+    
+json::Node JsonReader::GetJsonMapRender(int id, string raw_data) const {
+    return json::Builder{}
                 .StartDict()
                     .Key("map").Value(raw_data)
                     .Key("request_id").Value(id)
-                .EndDict().Build().AsDict();
-    result_.push_back(std::move(dict));
+                .EndDict().Build();
 }
     
-void JsonReader::SaveRouterData(int id, json::Dict raw_data) {
+json::Node JsonReader::GetJsonRouterData(int id, json::Dict raw_data) const {
     if (raw_data.empty()) {
-        result_.push_back(GetErrorMessage(id));
-        return;
+        return GetErrorMessage(id);
     }
-    json::Dict dict = json::Builder{}
+    return json::Builder{}
                 .StartDict()
                     .Key("request_id").Value(id)
                     .Key("total_time").Value(raw_data.at("total_time").AsDouble())
                     .Key("items").Value(raw_data.at("items").AsArray())
-                .EndDict().Build().AsDict();
-    result_.push_back(std::move(dict));
+                .EndDict().Build();
+}    
+    
+json::Node JsonReader::GetJsonRouteMatrix(int id, const TransportRouter::RouteMatrix &matrix) const {
+    // недостижимые пары и неизвестные остановки - null
+    json::Array rows;
+    rows.reserve(matrix.size());
+    for (const auto &row:matrix) {
+        json::Array times;
+        times.reserve(row.size());
+        for (const auto &time:row) {
+            if (time) {
+                times.emplace_back(*time);
+            } else {
+                times.emplace_back(nullptr);
+            }
+        }
+        rows.push_back(std::move(times));
+    }
+    return json::Builder{}
+                .StartDict()
+                    .Key("request_id").Value(id)
+                    .Key("total_times").Value(std::move(rows))
+                .EndDict().Build();
 }    
     
-json::Dict JsonReader::GetErrorMessage(int id) {
+json::Node JsonReader::GetJsonIsochrone(int id, const std::optional<TransportRouter::Isochrone> &isochrone) const {
+    if (!isochrone) {
+        return GetErrorMessage(id);
+    }
+    json::Array stops;
+    stops.reserve(isochrone->size());
+    for (const auto &[name, time]:*isochrone) {
+        stops.push_back(json::Builder{}
+                            .StartDict()
+                                .Key("stop_name").Value(std::string(name))
+                                .Key("time").Value(time)
+                            .EndDict().Build());
+    }
+    return json::Builder{}
+                .StartDict()
+                    .Key("request_id").Value(id)
+                    .Key("stops").Value(std::move(stops))
+                .EndDict().Build();
+}    
+    
+json::Dict JsonReader::GetErrorMessage(int id) const {
     return json::Builder{}
                 .StartDict()
                     .Key("request_id").Value(id)
@@ -188,10 +461,37 @@ void JsonReader::SetRouterSettings(TransportCatalogeHandler &catalogue_handler)
     
     auto dict = doc_.GetRoot().AsDict().at("routing_settings"s).AsDict();
     
-    int bus_wait_time = dict.at("bus_wait_time"s).AsInt();
-    double bus_velocity = dict.at("bus_velocity"s).AsDouble();
+    RoutingSettings settings;
+    settings.bus_wait_time = dict.at("bus_wait_time"s).AsInt();
+    settings.bus_velocity = dict.at("bus_velocity"s).AsDouble();
+    if (dict.count("router_type"s) > 0) {
+        settings.router_type = GetRouterTypeFromJson(dict.at("router_type"s));
+    }
+    if (dict.count("graph_model"s) > 0) {
+        settings.graph_model = GetGraphModelFromJson(dict.at("graph_model"s));
+    }
+    if (dict.count("threads"s) > 0) {
+        const int threads = dict.at("threads"s).AsInt();
+        if (threads < 0) {
+            throw std::invalid_argument("Routing threads should not be negative: "s + std::to_string(threads));
+        }
+        settings.thread_count = threads;
+    }
+    if (dict.count("route_cache_size"s) > 0) {
+        const int cache_size = dict.at("route_cache_size"s).AsInt();
+        if (cache_size < 0) {
+            throw std::invalid_argument("Route cache size should not be negative: "s + std::to_string(cache_size));
+        }
+        settings.route_cache_size = cache_size;
+    }
     
-    catalogue_handler.SetRouterSettings(bus_velocity, bus_wait_time);
+    if (doc_.GetRoot().AsDict().count("serialization_settings"s) == 0) {
+        catalogue_handler.SetRouterSettings(settings);
+        return;
+    }
+    // маршрутизатор переиспользуется из базы, которую заменит эта
+    auto serialization = doc_.GetRoot().AsDict().at("serialization_settings"s).AsDict();
+    catalogue_handler.SetRouterSettings(settings, serialization.at("file"s).AsString(), GetBaseFormat());
 }
     
 void JsonReader::SaveToFile(TransportCatalogeHandler &catalogue_handler) const {
@@ -200,16 +500,79 @@ void JsonReader::SaveToFile(TransportCatalogeHandler &catalogue_handler) const {
     }
     
     auto dict = doc_.GetRoot().AsDict().at("serialization_settings"s).AsDict();
-    catalogue_handler.SaveToFile(dict.at("file"s).AsString());
+    catalogue_handler.SaveToFile(dict.at("file"s).AsString(), GetBaseFormat());
+}
+
+serialization::BaseFormat JsonReader::GetBaseFormat() const {
+    const auto &dict = doc_.GetRoot().AsDict().at("serialization_settings"s).AsDict();
+    if (dict.count("format"s) > 0) {
+        return GetBaseFormatFromJson(dict.at("format"s));
+    }
+    return serialization::BaseFormat::PROTOBUF;
 }    
  
-void JsonReader::LoadFromFile(TransportCatalogeHandler &catalogue_handler) const {
+bool JsonReader::LoadFromFile(TransportCatalogeHandler &catalogue_handler) const {
+    return LoadFromFile(catalogue_handler, GetLoadParts());
+}
+
+bool JsonReader::LoadFromFile(TransportCatalogeHandler &catalogue_handler, serialization::LoadParts parts) const {
     if (doc_.GetRoot().AsDict().count("serialization_settings"s) == 0) {
-        return;
+        return true;
     }
     
     auto dict = doc_.GetRoot().AsDict().at("serialization_settings"s).AsDict();
-    catalogue_handler.LoadFromFile(dict.at("file"s).AsString());
+    if (!catalogue_handler.LoadFromFile(dict.at("file"s).AsString(), parts)) {
+        return false;
+    }
+    if (dict.count("patch"s) > 0) {
+        return catalogue_handler.ApplyPatchFromFile(dict.at("patch"s).AsString(), parts);
+    }
+    return true;
+}
+
+void JsonReader::SavePatchToFile(TransportCatalogeHandler &catalogue_handler) {
+    if (doc_.GetRoot().AsDict().count("serialization_settings"s) == 0) {
+        throw std::invalid_argument("No serialization_settings for patch");
+    }
+    
+    auto dict = doc_.GetRoot().AsDict().at("serialization_settings"s).AsDict();
+    const std::string base = dict.at("file"s).AsString();
+    const std::string patch = dict.at("patch"s).AsString();
+    // для сравнения нужен только справочник базы
+    if (!catalogue_handler.LoadFromFile(base, {false, false})) {
+        throw std::runtime_error("Cannot load base "s + base);
+    }
+    if (!catalogue_handler.SavePatchToFile(patch, ReadInputQuery())) {
+        throw std::runtime_error("Cannot write patch "s + patch);
+    }
+}
+    
+std::optional<std::string> JsonReader::GetServeSocket() const {
+    const auto &root = doc_.GetRoot().AsDict();
+    if (root.count("serve_settings"s) == 0) {
+        return std::nullopt;
+    }
+    const auto &settings = root.at("serve_settings"s).AsDict();
+    if (settings.count("socket"s) == 0) {
+        return std::nullopt;
+    }
+    return settings.at("socket"s).AsString();
+}
+    
+serialization::LoadParts JsonReader::GetLoadParts() const {
+    serialization::LoadParts parts{false, false};
+    if (doc_.GetRoot().AsDict().count("stat_requests"s) == 0) {
+        return parts;
+    }
+    for (const auto &item:doc_.GetRoot().AsDict().at("stat_requests"s).AsArray()) {
+        const auto &type = item.AsDict().at("type"s).AsString();
+        if (type == "Route"s || type == "RouteMatrix"s || type == "Isochrone"s) {
+            parts.router = true;
+        } else if (type == "Map"s) {
+            parts.renderer = true;
+        }
+    }
+    return parts;
 }
     
 void JsonReader::SetRenderSettings(TransportCatalogeHandler &catalogue_handler) const {
@@ -249,6 +612,39 @@ void JsonReader::SetRenderSettings(TransportCatalogeHandler &catalogue_handler)
     catalogue_handler.SetRenderSettings(setting);
 }
  
+serialization::BaseFormat JsonReader::GetBaseFormatFromJson(const json::Node &format) const {
+    if (format.AsString() == "protobuf"s) {
+        return serialization::BaseFormat::PROTOBUF;
+    } else if (format.AsString() == "flat"s) {
+        return serialization::BaseFormat::FLAT;
+    }
+    throw std::invalid_argument("Unknown base format: "s + format.AsString());
+}
+    
+RouterType JsonReader::GetRouterTypeFromJson(const json::Node &router_type) const {
+    if (router_type.AsString() == "all_pairs"s) {
+        return RouterType::ALL_PAIRS;
+    } else if (router_type.AsString() == "dijkstra"s) {
+        return RouterType::DIJKSTRA;
+    } else if (router_type.AsString() == "raptor"s) {
+        return RouterType::RAPTOR;
+    } else if (router_type.AsString() == "astar"s) {
+        return RouterType::ASTAR;
+    } else if (router_type.AsString() == "hub_labels"s) {
+        return RouterType::HUB_LABELS;
+    }
+    throw std::invalid_argument("Unknown router_type: "s + router_type.AsString());
+}
+    
+GraphModel JsonReader::GetGraphModelFromJson(const json::Node &graph_model) const {
+    if (graph_model.AsString() == "pairwise"s) {
+        return GraphModel::PAIRWISE;
+    } else if (graph_model.AsString() == "linear"s) {
+        return GraphModel::LINEAR;
+    }
+    throw std::invalid_argument("Unknown graph_model: "s + graph_model.AsString());
+}
+    
 vector<svg::Color> JsonReader::GetColorPaletteFromJson(const json::Node &palette) const {
     vector<string> result;
     for (auto &color:palette.AsArray()) {
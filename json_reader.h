@@ -4,6 +4,7 @@
 #include "request_handler.h"
 #include "json.h"
 #include "domain.h"
+#include "thread_pool.h"
 
 namespace reader {
     
@@ -21,6 +22,8 @@ protected:
     virtual void SaveStopInfo(int id, const domain::StopInfo &stop) = 0;
     virtual void SaveMapRender(int id, std::string raw_data) = 0;
     virtual void SaveRouterData(int id, json::Dict raw_data) = 0;
+    virtual void SaveRouteMatrix(int id, const TransportRouter::RouteMatrix &matrix) = 0;
+    virtual void SaveIsochrone(int id, const std::optional<TransportRouter::Isochrone> &isochrone) = 0;
 };
 
 class JsonReader: public ITransportCatalogeReader {
@@ -30,7 +33,19 @@ public:
     void SetRenderSettings(TransportCatalogeHandler &catalogue_handler) const;
     void SetRouterSettings(TransportCatalogeHandler &catalogue_handler) const;
     void SaveToFile(TransportCatalogeHandler &catalogue_handler) const;
-    void LoadFromFile(TransportCatalogeHandler &catalogue_handler) const;
+    // загрузка базы и, если задан serialization_settings.patch, применение правки;
+    // false - база или правка не прочитаны
+    bool LoadFromFile(TransportCatalogeHandler &catalogue_handler) const;
+    // то же с заданными частями базы (запросы заранее неизвестны)
+    bool LoadFromFile(TransportCatalogeHandler &catalogue_handler, serialization::LoadParts parts) const;
+    // путь локального сокета для запросов из serve_settings.socket (нет - запросы из stdin)
+    std::optional<std::string> GetServeSocket() const;
+    // правка serialization_settings.patch из base_requests к базе serialization_settings.file;
+    // база не прочитана или правка не записана - исключение
+    void SavePatchToFile(TransportCatalogeHandler &catalogue_handler);
+    // вывод счётчиков маршрутизации, если включён process_settings.search_stats;
+    // у A* рядом - число вершин тех же поисков без эвристики
+    void PrintStats(const TransportCatalogeHandler &catalogue_handler, std::ostream &out) const;
 
 protected: 
     domain::InputData ReadInputQuery() override;
@@ -39,6 +54,8 @@ protected:
     void SaveStopInfo(int id, const domain::StopInfo &stop) override;
     void SaveMapRender(int id, std::string raw_data) override;
     void SaveRouterData(int id, json::Dict raw_data) override;
+    void SaveRouteMatrix(int id, const TransportRouter::RouteMatrix &matrix) override;
+    void SaveIsochrone(int id, const std::optional<TransportRouter::Isochrone> &isochrone) override;
     void ResetResult() override;
 private:
     json::Document doc_;
@@ -47,13 +64,38 @@ private:
     //
     domain::BusRoute ParseBus(const json::Dict &dict);
     domain::RoutesStop ParseStop(const json::Dict &dict);
+    std::optional<domain::BusTimetable> ParseTimetable(const json::Dict &dict);
     void ParseQuery(TransportCatalogeHandler &catalogue_handler, const json::Dict &dict);
-    json::Node GetJsonBusInfo(int id, const domain::BusInfo &bus);
-    json::Node GetJsonStopInfo(int id, const domain::StopInfo &stop);
+    std::optional<int> GetMaxTransfers(const json::Dict &dict) const;
+    std::vector<std::string> GetStopNames(const json::Node &names) const;
+    std::optional<double> GetDepartureTime(const json::Dict &dict) const;
+    bool IsBatchRouting() const;
+    // ответы на все запросы Route, сгруппированные по остановке отправления
+    std::vector<std::optional<json::Dict>> BatchRoutes(TransportCatalogeHandler &catalogue_handler, const json::Array &requests,
+                                                       parallel::ThreadPool *pool) const;
+    // ответ на один запрос без записи в result_, безопасен для параллельного вызова
+    json::Node AnswerQuery(TransportCatalogeHandler &catalogue_handler, const json::Dict &dict) const;
+    // число потоков обработки запросов (нет - последовательная обработка)
+    std::optional<size_t> GetProcessThreads() const;
+    // включён process_settings.search_stats: A* считает и вершины поисков без эвристики
+    bool IsSearchStats() const;
+    // части базы, нужные запросам stat_requests
+    serialization::LoadParts GetLoadParts() const;
+    json::Node GetJsonBusInfo(int id, const domain::BusInfo &bus) const;
+    json::Node GetJsonStopInfo(int id, const domain::StopInfo &stop) const;
+    json::Node GetJsonMapRender(int id, std::string raw_data) const;
+    json::Node GetJsonRouterData(int id, json::Dict raw_data) const;
+    json::Node GetJsonRouteMatrix(int id, const TransportRouter::RouteMatrix &matrix) const;
+    json::Node GetJsonIsochrone(int id, const std::optional<TransportRouter::Isochrone> &isochrone) const;
     
     svg::Color GetColorFromJson(const json::Node &color) const;
     std::vector<svg::Color> GetColorPaletteFromJson(const json::Node &palette) const;
-    json::Dict GetErrorMessage(int id);
+    RouterType GetRouterTypeFromJson(const json::Node &router_type) const;
+    serialization::BaseFormat GetBaseFormatFromJson(const json::Node &format) const;
+    // формат базы из serialization_settings
+    serialization::BaseFormat GetBaseFormat() const;
+    GraphModel GetGraphModelFromJson(const json::Node &graph_model) const;
+    json::Dict GetErrorMessage(int id) const;
 
 };
     
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdlib>
+#include <functional>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace cache {
+
+// кэш ограниченного размера с вытеснением давно не использованных записей
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+    explicit LruCache(size_t capacity = 0)
+        : capacity_(capacity) {
+    }
+
+    // capacity == 0 - кэш отключён
+    void SetCapacity(size_t capacity) {
+        capacity_ = capacity;
+        while (items_.size() > capacity_) {
+            index_.erase(items_.back().first);
+            items_.pop_back();
+        }
+    }
+
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+    size_t GetSize() const {
+        return items_.size();
+    }
+
+    std::optional<Value> Get(const Key& key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            ++misses_;
+            return std::nullopt;
+        }
+        ++hits_;
+        items_.splice(items_.begin(), items_, it->second);
+        return it->second->second;
+    }
+
+    void Put(const Key& key, Value value) {
+        if (capacity_ == 0) {
+            return;
+        }
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            it->second->second = std::move(value);
+            items_.splice(items_.begin(), items_, it->second);
+            return;
+        }
+        if (items_.size() == capacity_) {
+            index_.erase(items_.back().first);
+            items_.pop_back();
+        }
+        items_.emplace_front(key, std::move(value));
+        index_[key] = items_.begin();
+    }
+
+    void Clear() {
+        items_.clear();
+        index_.clear();
+    }
+
+    size_t GetHits() const {
+        return hits_;
+    }
+
+    size_t GetMisses() const {
+        return misses_;
+    }
+
+private:
+    using Item = std::pair<Key, Value>;
+
+    size_t capacity_;
+    // записи от недавно использованных к давно использованным
+    std::list<Item> items_;
+    std::unordered_map<Key, typename std::list<Item>::iterator, Hash> index_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+}  // namespace cache
@@ -6,6 +6,8 @@
 #include "json.h"
 #include "svg.h"
 #include "json_reader.h"
+#include "request_server.h"
+#include "snapshot.h"
 #include "map_renderer.h"
 #include "transport_router.h"
 #include "transport_catalogue.h"
@@ -13,7 +15,7 @@
 using namespace std::literals;
 
 void PrintUsage(std::ostream& stream = std::cerr) {
-    stream << "Usage: transport_catalogue [make_base|process_requests]\n"sv;
+    stream << "Usage: transport_catalogue [make_base|make_patch|process_requests|serve]\n"sv;
 }
 
 void make_base() {
@@ -31,7 +33,7 @@ void make_base() {
     reader_.SaveToFile(handle);
 }
 
-void process_requests() {
+bool make_patch() {
     auto cataloge = transport_cataloge::TransportCatalogue();
     renderer::TransportCatalogeRendererSVG renderer(cataloge);
     TransportRouter router(cataloge);
@@ -40,10 +42,54 @@ void process_requests() {
     auto handle = TransportCatalogeHandler(cataloge, renderer, router, serializator);
     auto doc = json::Load(std::cin);
     auto reader_ = reader::JsonReader(doc);
-    reader_.LoadFromFile(handle);
+    try {
+        reader_.SavePatchToFile(handle);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool process_requests() {
+    auto cataloge = transport_cataloge::TransportCatalogue();
+    renderer::TransportCatalogeRendererSVG renderer(cataloge);
+    TransportRouter router(cataloge);
+    serialization::TransportCatalogSerialization serializator;
+    
+    auto handle = TransportCatalogeHandler(cataloge, renderer, router, serializator);
+    auto doc = json::Load(std::cin);
+    auto reader_ = reader::JsonReader(doc);
+    // неприменимая правка - ошибка, а не ответы по другой базе
+    if (!reader_.LoadFromFile(handle)) {
+        std::cerr << "Cannot load base\n"sv;
+        return false;
+    }
     reader_.RunQuery(handle);
     auto result = reader_.GetResultQuery();
     json::Print(result, std::cout);
+    reader_.PrintStats(handle, std::cerr);
+    return true;
+}
+
+// первый документ stdin - настройки: база и, если задан serve_settings.socket, сокет;
+// затем документы с запросами по одному на строку из stdin или из соединений с сокетом
+bool serve() {
+    auto doc = json::Load(std::cin);
+    auto reader_ = reader::JsonReader(doc);
+    try {
+        // будущие запросы неизвестны, база загружается целиком
+        server::RequestServer server(server::Snapshot::Load(doc));
+        if (auto socket = reader_.GetServeSocket()) {
+            server.ServeSocket(*socket);
+        } else {
+            server.Serve(std::cin, std::cout);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return false;
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
@@ -56,8 +102,18 @@ int main(int argc, char* argv[]) {
 
     if (mode == "make_base"sv) {
         make_base();
+    } else if (mode == "make_patch"sv) {
+        if (!make_patch()) {
+            return 1;
+        }
     } else if (mode == "process_requests"sv) {
-        process_requests();
+        if (!process_requests()) {
+            return 1;
+        }
+    } else if (mode == "serve"sv) {
+        if (!serve()) {
+            return 1;
+        }
     } else {
         PrintUsage();
         return 1;
@@ -0,0 +1,164 @@
+#include "raptor_router.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace raptor {
+
+RaptorRouter::RaptorRouter(size_t stop_count, std::vector<Pattern> patterns, double velocity, double wait_time)
+    : stop_count_(stop_count)
+    , patterns_(std::move(patterns))
+    , stop_patterns_(stop_count)
+    , velocity_(velocity)
+    , wait_time_(wait_time) {
+    for (size_t pattern = 0; pattern < patterns_.size(); pattern++) {
+        const auto &stops = patterns_[pattern].stops;
+        if (stops.size() != patterns_[pattern].distances.size()) {
+            throw invalid_argument("Pattern stops and distances size mismatch");
+        }
+        for (size_t position = 0; position < stops.size(); position++) {
+            stop_patterns_.at(stops[position]).push_back({pattern, position});
+        }
+    }
+}
+
+size_t RaptorRouter::GetStopCount() const {
+    return stop_count_;
+}
+
+double RaptorRouter::GetRideTime(const Pattern& pattern, size_t board_position, size_t position) const {
+    return (pattern.distances[position] - pattern.distances[board_position]) / velocity_;
+}
+
+RaptorRouter::SearchResult RaptorRouter::Run(StopId from, std::optional<StopId> to, std::optional<int> max_transfers) const {
+    if (from >= stop_count_ || (to && *to >= stop_count_)) {
+        throw out_of_range("Stop is out of router");
+    }
+    SearchResult result;
+    result.router_ = this;
+    result.from_ = from;
+    result.best_arrivals_.assign(stop_count_, UNREACHABLE);
+    result.best_arrivals_[from] = 0;
+    result.arrivals_.push_back(result.best_arrivals_);
+    result.parents_.emplace_back(stop_count_);
+
+    const size_t NO_POSITION = numeric_limits<size_t>::max();
+    vector<size_t> first_positions(patterns_.size(), NO_POSITION);
+    vector<size_t> queued_patterns;
+    vector<bool> marked(stop_count_, false);
+    vector<bool> boardable(stop_count_, false);
+    marked[from] = true;
+    vector<StopId> marked_stops = {from};
+    vector<StopId> boarding_stops;
+
+    for (size_t round = 1; !max_transfers || round <= static_cast<size_t>(*max_transfers) + 1; round++) {
+        // маршруты через отмеченные остановки сканируются с самой ранней из них
+        queued_patterns.clear();
+        // садиться имеет смысл только на остановках, улучшенных в прошлом раунде:
+        // с прежними метками маршруты уже сканировались
+        boardable.swap(marked);
+        for (StopId stop : marked_stops) {
+            for (const auto &stop_pattern : stop_patterns_[stop]) {
+                size_t &first_position = first_positions[stop_pattern.pattern];
+                if (first_position == NO_POSITION) {
+                    queued_patterns.push_back(stop_pattern.pattern);
+                    first_position = stop_pattern.position;
+                } else {
+                    first_position = min(first_position, stop_pattern.position);
+                }
+            }
+        }
+        boarding_stops.swap(marked_stops);
+        marked_stops.clear();
+        if (queued_patterns.empty()) {
+            break;
+        }
+
+        result.arrivals_.push_back(result.arrivals_.back());
+        result.parents_.emplace_back(stop_count_);
+        const auto &previous = result.arrivals_[round - 1];
+        auto &current = result.arrivals_[round];
+        auto &parents = result.parents_[round];
+
+        for (size_t pattern_id : queued_patterns) {
+            const Pattern &pattern = patterns_[pattern_id];
+            bool boarded = false;
+            size_t board_position = 0;
+            double board_time = 0;
+            for (size_t position = first_positions[pattern_id]; position < pattern.stops.size(); position++) {
+                const StopId stop = pattern.stops[position];
+                double arrival = UNREACHABLE;
+                if (boarded) {
+                    arrival = board_time + GetRideTime(pattern, board_position, position);
+                    const double bound = min(result.best_arrivals_[stop], to ? result.best_arrivals_[*to] : UNREACHABLE);
+                    if (arrival < bound) {
+                        current[stop] = arrival;
+                        result.best_arrivals_[stop] = arrival;
+                        parents[stop] = {pattern_id, board_position, position};
+                        if (!marked[stop]) {
+                            marked[stop] = true;
+                            marked_stops.push_back(stop);
+                        }
+                    }
+                }
+                // посадка здесь выгоднее, если на этот автобус успеваем раньше
+                // и ещё можно улучшить время прибытия в цель
+                const double departure = previous[stop] + wait_time_;
+                if (boardable[stop] && departure < arrival
+                    && (!to || departure < result.best_arrivals_[*to])) {
+                    boarded = true;
+                    board_position = position;
+                    board_time = departure;
+                }
+            }
+            first_positions[pattern_id] = NO_POSITION;
+        }
+        for (StopId stop : boarding_stops) {
+            boardable[stop] = false;
+        }
+    }
+    return result;
+}
+
+std::optional<Journey> RaptorRouter::SearchResult::GetJourney(StopId to) const {
+    if (to >= best_arrivals_.size() || best_arrivals_[to] == UNREACHABLE) {
+        return nullopt;
+    }
+    Journey journey{best_arrivals_[to], {}};
+    size_t round = arrivals_.size() - 1;
+    for (StopId stop = to; stop != from_; round--) {
+        // метка могла быть получена в одном из предыдущих раундов
+        while (parents_[round][stop].pattern == NO_PATTERN) {
+            round--;
+        }
+        const Parent &parent = parents_[round][stop];
+        const Pattern &pattern = router_->patterns_[parent.pattern];
+        const StopId board_stop = pattern.stops[parent.board_position];
+        journey.legs.push_back({pattern.bus_id, board_stop,
+                                static_cast<int>(parent.alight_position - parent.board_position),
+                                router_->GetRideTime(pattern, parent.board_position, parent.alight_position)});
+        stop = board_stop;
+    }
+    reverse(journey.legs.begin(), journey.legs.end());
+    return journey;
+}
+
+std::optional<double> RaptorRouter::SearchResult::GetTotalTime(StopId to) const {
+    if (to >= best_arrivals_.size() || best_arrivals_[to] == UNREACHABLE) {
+        return nullopt;
+    }
+    return best_arrivals_[to];
+}
+
+std::optional<Journey> RaptorRouter::BuildRoute(StopId from, StopId to, std::optional<int> max_transfers) const {
+    return Run(from, to, max_transfers).GetJourney(to);
+}
+
+RaptorRouter::SearchResult RaptorRouter::BuildRoutes(StopId from, std::optional<int> max_transfers) const {
+    return Run(from, nullopt, max_transfers);
+}
+
+}  // namespace raptor
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace raptor {
+
+using StopId = size_t;
+
+// одно направление маршрута автобуса
+struct Pattern {
+    size_t bus_id;
+    std::vector<StopId> stops;
+    // расстояние от первой остановки направления до каждой остановки
+    std::vector<double> distances;
+};
+
+// участок пути на одном автобусе
+struct Leg {
+    size_t bus_id;
+    StopId board_stop;
+    int span_count;
+    double ride_time;
+};
+
+struct Journey {
+    double total_time;
+    std::vector<Leg> legs;
+};
+
+// поиск по раундам (RAPTOR): раунд k находит лучшие времена с k поездками,
+// сканируя последовательности остановок маршрутов вместо графа
+class RaptorRouter {
+public:
+    RaptorRouter() = default;
+    // velocity - скорость (м/мин), wait_time - ожидание на остановке перед посадкой (мин)
+    RaptorRouter(size_t stop_count, std::vector<Pattern> patterns, double velocity, double wait_time);
+
+    // результат поиска из одной остановки до всех остальных
+    class SearchResult {
+    public:
+        std::optional<Journey> GetJourney(StopId to) const;
+        // только время пути, без восстановления поездок
+        std::optional<double> GetTotalTime(StopId to) const;
+    private:
+        friend class RaptorRouter;
+        struct Parent {
+            size_t pattern = NO_PATTERN;
+            size_t board_position = 0;
+            size_t alight_position = 0;
+        };
+        const RaptorRouter* router_ = nullptr;
+        StopId from_ = 0;
+        // метки и способ прибытия по раундам
+        std::vector<std::vector<double>> arrivals_;
+        std::vector<std::vector<Parent>> parents_;
+        std::vector<double> best_arrivals_;
+    };
+
+    // max_transfers - ограничение числа пересадок (нет - без ограничения)
+    std::optional<Journey> BuildRoute(StopId from, StopId to, std::optional<int> max_transfers = std::nullopt) const;
+    SearchResult BuildRoutes(StopId from, std::optional<int> max_transfers = std::nullopt) const;
+
+    size_t GetStopCount() const;
+
+private:
+    static constexpr double UNREACHABLE = std::numeric_limits<double>::infinity();
+    static constexpr size_t NO_PATTERN = std::numeric_limits<size_t>::max();
+
+    // маршрут, проходящий через остановку, и позиция остановки в нём
+    struct StopPattern {
+        size_t pattern;
+        size_t position;
+    };
+
+    size_t stop_count_ = 0;
+    std::vector<Pattern> patterns_;
+    std::vector<std::vector<StopPattern>> stop_patterns_;
+    double velocity_ = 1;
+    double wait_time_ = 0;
+
+    SearchResult Run(StopId from, std::optional<StopId> to, std::optional<int> max_transfers) const;
+    double GetRideTime(const Pattern& pattern, size_t board_position, size_t position) const;
+};
+
+}  // namespace raptor
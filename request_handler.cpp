@@ -25,22 +25,73 @@ void TransportCatalogeHandler::SetRenderSettings(renderer::RenderSettings settin
 }
 
 std::string TransportCatalogeHandler::RenderMap() const {
-    renderer_.RenderMap();
-    return renderer_.GetSVGResultAsString();
+    // отдельный рисовальщик на каждый вызов: карта не накапливается между запросами
+    // и может строиться одновременно из нескольких потоков
+    renderer::TransportCatalogeRendererSVG renderer(db_);
+    renderer.SetRenderSettings(renderer_.GetRenderSettings());
+    renderer.RenderMap();
+    return renderer.GetSVGResultAsString();
 }
 
-void TransportCatalogeHandler::SetRouterSettings(double bus_velocity, int bus_wait_time) {
-    router_.BuildRouter(bus_velocity, bus_wait_time);
+void TransportCatalogeHandler::SetRouterSettings(const RoutingSettings &settings) {
+    serializator_.SetRoutingFingerprint(0);
+    router_.BuildRouter(settings);
 }
 
-json::Dict TransportCatalogeHandler::GetRoute(std::string from, std::string to) {
-    return router_.GetRoute(from , to);
+void TransportCatalogeHandler::SetRouterSettings(const RoutingSettings &settings, const std::string &previousBase, serialization::BaseFormat format) {
+    serializator_.SetRoutingFingerprint(router_.GetFingerprint(settings));
+    if (!serializator_.ReuseRouterFromFile(previousBase, format)) {
+        router_.BuildRouter(settings);
+    }
 }
 
-void TransportCatalogeHandler::SaveToFile(const std::string fileName) {
-    serializator_.SaveToFile(fileName, db_, renderer_, router_);
+json::Dict TransportCatalogeHandler::GetRoute(std::string from, std::string to, std::optional<int> max_transfers,
+                                              std::optional<double> departure_time) {
+    return router_.GetRoute(from , to, max_transfers, departure_time);
 }
 
-void TransportCatalogeHandler::LoadFromFile(const std::string fileName) {
-    serializator_.LoadFromFile(fileName, db_, renderer_, router_);
+graph::SearchStats TransportCatalogeHandler::GetSearchStats() const {
+    return router_.GetSearchStats();
+}
+
+void TransportCatalogeHandler::SetBaselineSearchStats(bool enabled) {
+    router_.SetBaselineStats(enabled);
+}
+
+TransportRouter::RouteCacheStats TransportCatalogeHandler::GetRouteCacheStats() const {
+    return router_.GetRouteCacheStats();
+}
+
+std::vector<json::Dict> TransportCatalogeHandler::GetRoutes(const std::string &from, const std::vector<std::string> &to, std::optional<int> max_transfers) {
+    return router_.GetRoutes(from, to, max_transfers);
+}
+
+TransportRouter::RouteMatrix TransportCatalogeHandler::GetRouteMatrix(const std::vector<std::string> &from, const std::vector<std::string> &to,
+                                                                     std::optional<int> max_transfers) const {
+    return router_.GetRouteMatrix(from, to, max_transfers);
+}
+
+std::optional<TransportRouter::Isochrone> TransportCatalogeHandler::GetIsochrone(const std::string &from, double max_time,
+                                                                                std::optional<int> max_transfers) const {
+    return router_.GetIsochrone(from, max_time, max_transfers);
+}
+
+void TransportCatalogeHandler::SetTimetables(std::vector<domain::BusTimetable> timetables) {
+    router_.SetTimetables(std::move(timetables));
+}
+
+void TransportCatalogeHandler::SaveToFile(const std::string fileName, serialization::BaseFormat format) {
+    serializator_.SaveToFile(fileName, db_, renderer_, router_, format);
+}
+
+bool TransportCatalogeHandler::LoadFromFile(const std::string fileName, serialization::LoadParts parts) {
+    return serializator_.LoadFromFile(fileName, db_, renderer_, router_, parts);
+}
+
+bool TransportCatalogeHandler::SavePatchToFile(const std::string fileName, const domain::InputData &input) {
+    return serializator_.SavePatchToFile(fileName, db_, input);
+}
+
+bool TransportCatalogeHandler::ApplyPatchFromFile(const std::string fileName, serialization::LoadParts parts) {
+    return serializator_.ApplyPatchFromFile(fileName, db_, router_, parts);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <string_view>
 #include <string>
+#include <optional>
 
 #include "svg.h"
 #include "domain.h"
@@ -23,9 +24,16 @@ public:
 
     std::string RenderMap() const;
     void SetRenderSettings(renderer::RenderSettings settings);
-    void SetRouterSettings(double bus_velocity, int bus_wait_time);
-    void SaveToFile(const std::string fileName);
-    void LoadFromFile(const std::string fileName);
+    void SetRouterSettings(const RoutingSettings &settings);
+    // то же для записи в базу: если прежняя база previousBase того же формата собрана из тех же
+    // входных данных маршрутизатора, он не строится, а копируется из неё при записи
+    void SetRouterSettings(const RoutingSettings &settings, const std::string &previousBase, serialization::BaseFormat format);
+    void SetTimetables(std::vector<domain::BusTimetable> timetables);
+    void SaveToFile(const std::string fileName, serialization::BaseFormat format = serialization::BaseFormat::PROTOBUF);
+    bool LoadFromFile(const std::string fileName, serialization::LoadParts parts = {});
+    // правка базы: запись отличий input от загруженной базы и применение к загруженной базе
+    bool SavePatchToFile(const std::string fileName, const domain::InputData &input);
+    bool ApplyPatchFromFile(const std::string fileName, serialization::LoadParts parts = {});
     
     void AddStop(domain::RoutesStop &s);
     void AddBus(domain::BusRoute &b);
@@ -33,7 +41,16 @@ public:
     
     domain::BusInfo GetBusInfo(const std::string &Number) const;
     domain::StopInfo GetStopInfo(const std::string &Name) const;
-    json::Dict GetRoute(std::string from, std::string to);
+    json::Dict GetRoute(std::string from, std::string to, std::optional<int> max_transfers = std::nullopt,
+                        std::optional<double> departure_time = std::nullopt);
+    graph::SearchStats GetSearchStats() const;
+    void SetBaselineSearchStats(bool enabled);
+    TransportRouter::RouteCacheStats GetRouteCacheStats() const;
+    std::vector<json::Dict> GetRoutes(const std::string &from, const std::vector<std::string> &to, std::optional<int> max_transfers = std::nullopt);
+    TransportRouter::RouteMatrix GetRouteMatrix(const std::vector<std::string> &from, const std::vector<std::string> &to,
+                                                std::optional<int> max_transfers = std::nullopt) const;
+    std::optional<TransportRouter::Isochrone> GetIsochrone(const std::string &from, double max_time,
+                                                           std::optional<int> max_transfers = std::nullopt) const;
     
 private:
     transport_cataloge::TransportCatalogue& db_;
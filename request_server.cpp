@@ -0,0 +1,343 @@
+#include "request_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "json.h"
+#include "json_reader.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define REQUEST_SERVER_SOCKET 1
+#endif
+
+using namespace std;
+
+namespace server {
+
+namespace {
+
+#ifdef REQUEST_SERVER_SOCKET
+// запись всех байтов; закрытое клиентом соединение - false, а не сигнал
+bool WriteAll(int fd, string_view data) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (!data.empty()) {
+        const ssize_t written = send(fd, data.data(), data.size(), flags);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
+
+// слушающий сокет закрывается и его файл удаляется при любом выходе из ServeSocket
+class ListeningSocket {
+public:
+    ListeningSocket(int fd, std::string path)
+        : fd_(fd), path_(std::move(path)) {
+    }
+
+    ListeningSocket(const ListeningSocket&) = delete;
+    ListeningSocket& operator=(const ListeningSocket&) = delete;
+
+    ~ListeningSocket() {
+        close(fd_);
+        unlink(path_.c_str());
+    }
+
+    int Get() const {
+        return fd_;
+    }
+
+private:
+    int fd_;
+    std::string path_;
+};
+
+// конец записи канала остановки для обработчика сигнала
+volatile sig_atomic_t stop_write_fd = -1;
+
+extern "C" void OnStopSignal(int) {
+    const int saved_errno = errno;
+    const char byte = 0;
+    [[maybe_unused]] const ssize_t written = write(stop_write_fd, &byte, 1);
+    errno = saved_errno;
+}
+
+// SIGINT и SIGTERM на время работы ServeSocket не завершают процесс, а делают канал
+// читаемым: цикл приёма ждёт его вместе с сокетом и выходит, сработав деструкторы
+class StopSignals {
+public:
+    StopSignals() {
+        if (pipe(fds_) != 0) {
+            throw runtime_error("Cannot create pipe: "s + strerror(errno));
+        }
+        for (int fd:fds_) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+        stop_write_fd = fds_[1];
+        struct sigaction action{};
+        action.sa_handler = OnStopSignal;
+        sigemptyset(&action.sa_mask);
+        // прерванные вызовы в потоках соединений продолжаются
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGINT, &action, &old_int_);
+        sigaction(SIGTERM, &action, &old_term_);
+    }
+
+    StopSignals(const StopSignals&) = delete;
+    StopSignals& operator=(const StopSignals&) = delete;
+
+    ~StopSignals() {
+        sigaction(SIGINT, &old_int_, nullptr);
+        sigaction(SIGTERM, &old_term_, nullptr);
+        stop_write_fd = -1;
+        close(fds_[0]);
+        close(fds_[1]);
+    }
+
+    int Get() const {
+        return fds_[0];
+    }
+
+private:
+    int fds_[2] = {-1, -1};
+    struct sigaction old_int_{};
+    struct sigaction old_term_{};
+};
+
+// потоки соединений: закончившиеся присоединяются при запуске следующих,
+// остальные - при уничтожении, поэтому сервер переживает все свои соединения;
+// соединение закрывается здесь, после его обработки
+class ConnectionThreads {
+public:
+    ConnectionThreads() = default;
+    ConnectionThreads(const ConnectionThreads&) = delete;
+    ConnectionThreads& operator=(const ConnectionThreads&) = delete;
+
+    ~ConnectionThreads() {
+        for (auto &[id, connection]:threads_) {
+            connection.join();
+        }
+    }
+
+    template <typename Func>
+    void Start(int fd, Func func) {
+        JoinFinished();
+        {
+            lock_guard lock(mutex_);
+            open_fds_.insert(fd);
+        }
+        try {
+            thread connection([this, fd, func = std::move(func)] {
+                func(fd);
+                lock_guard lock(mutex_);
+                open_fds_.erase(fd);
+                close(fd);
+                finished_.push_back(this_thread::get_id());
+            });
+            const auto id = connection.get_id();
+            threads_.emplace(id, std::move(connection));
+        } catch (...) {
+            lock_guard lock(mutex_);
+            open_fds_.erase(fd);
+            close(fd);
+            throw;
+        }
+    }
+
+    // новых документов из открытых соединений не будет: уже полученные дообслуживаются
+    void StopReading() {
+        lock_guard lock(mutex_);
+        for (int fd:open_fds_) {
+            shutdown(fd, SHUT_RD);
+        }
+    }
+
+private:
+    // threads_ меняется только в потоке приёма, open_fds_ и finished_ - под mutex_
+    unordered_map<thread::id, thread> threads_;
+    mutex mutex_;
+    unordered_set<int> open_fds_;
+    vector<thread::id> finished_;
+
+    void JoinFinished() {
+        vector<thread::id> finished;
+        {
+            lock_guard lock(mutex_);
+            finished.swap(finished_);
+        }
+        for (const auto &id:finished) {
+            auto it = threads_.find(id);
+            it->second.join();
+            threads_.erase(it);
+        }
+    }
+};
+#endif
+
+}  // namespace
+
+RequestServer::RequestServer(std::shared_ptr<Snapshot> snapshot)
+    : snapshot_(std::move(snapshot)) {
+}
+
+std::optional<std::string> RequestServer::Answer(std::string_view line, std::shared_ptr<Snapshot> &snapshot) {
+    if (all_of(line.begin(), line.end(), [](char c) {
+            return isspace(static_cast<unsigned char>(c));
+        })) {
+        return nullopt;
+    }
+    ostringstream output;
+    try {
+        istringstream input{string(line)};
+        const auto doc = json::Load(input);
+        if (doc.GetRoot().AsDict().count("serialization_settings"s) > 0) {
+            // запросы, начатые до подмены, заканчиваются на прежней базе
+            auto loaded = Snapshot::Load(doc);
+            atomic_store(&snapshot_, loaded);
+            snapshot = std::move(loaded);
+        }
+        auto reader = reader::JsonReader(doc);
+        reader.RunQuery(snapshot->GetHandler());
+        json::PrintCompact(reader.GetResultQuery(), output);
+        reader.PrintStats(snapshot->GetHandler(), cerr);
+    } catch (const exception &e) {
+        output.str({});
+        json::PrintCompact(json::Document{json::Dict{{"error_message"s, string(e.what())}}}, output);
+    }
+    return output.str();
+}
+
+void RequestServer::Serve(std::istream &input, std::ostream &output) {
+    string line;
+    while (getline(input, line)) {
+        auto snapshot = atomic_load(&snapshot_);
+        if (auto answer = Answer(line, snapshot)) {
+            output << *answer << '\n' << flush;
+        }
+    }
+}
+
+#ifdef REQUEST_SERVER_SOCKET
+void RequestServer::ServeSocket(const std::string &socket_path) {
+    sockaddr_un address{};
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw invalid_argument("Socket path is too long: "s + socket_path);
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, socket_path.data(), socket_path.size());
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        throw runtime_error("Cannot create socket: "s + strerror(errno));
+    }
+    // сокет от прошлого запуска
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const string error = strerror(errno);
+        close(listen_fd);
+        throw runtime_error("Cannot listen on socket "s + socket_path + ": "s + error);
+    }
+
+    // при выходе сначала закрывается сокет, затем дожидаются соединения:
+    // их потоки обращаются к серверу
+    ConnectionThreads connections;
+    const ListeningSocket listening(listen_fd, socket_path);
+    const StopSignals stop;
+    if (listen(listening.Get(), SOMAXCONN) != 0) {
+        throw runtime_error("Cannot listen on socket "s + socket_path + ": "s + strerror(errno));
+    }
+
+    pollfd waited[] = {{listening.Get(), POLLIN, 0}, {stop.Get(), POLLIN, 0}};
+    for (;;) {
+        if (poll(waited, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Cannot wait for connection: "s + strerror(errno));
+        }
+        if (waited[1].revents != 0) {
+            connections.StopReading();
+            return;
+        }
+        if (waited[0].revents == 0) {
+            continue;
+        }
+        const int fd = accept(listening.Get(), nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            throw runtime_error("Cannot accept connection: "s + strerror(errno));
+        }
+        // соединение живёт, пока его держит клиент, поэтому у каждого свой поток
+        connections.Start(fd, [this](int connection_fd) {
+            ServeConnection(connection_fd);
+        });
+    }
+}
+
+void RequestServer::ServeConnection(int fd) {
+    string buffer;
+    char chunk[1 << 16];
+    for (;;) {
+        const ssize_t count = read(fd, chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        buffer.append(chunk, static_cast<size_t>(count));
+        size_t start = 0;
+        for (size_t end = buffer.find('\n'); end != string::npos; end = buffer.find('\n', start)) {
+            auto snapshot = atomic_load(&snapshot_);
+            auto answer = Answer(string_view(buffer).substr(start, end - start), snapshot);
+            start = end + 1;
+            if (answer && !WriteAll(fd, *answer + '\n')) {
+                return;
+            }
+        }
+        buffer.erase(0, start);
+    }
+    // последний документ без перевода строки
+    auto snapshot = atomic_load(&snapshot_);
+    if (auto answer = Answer(buffer, snapshot)) {
+        WriteAll(fd, *answer + '\n');
+    }
+}
+#else
+void RequestServer::ServeSocket(const std::string &socket_path) {
+    throw runtime_error("Unix domain sockets are not supported: "s + socket_path);
+}
+
+void RequestServer::ServeConnection(int) {
+}
+#endif
+
+}  // namespace server
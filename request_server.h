@@ -0,0 +1,44 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "snapshot.h"
+
+namespace server {
+
+// ответы на документы с запросами (stat_requests, process_settings) над базой, загруженной
+// один раз: документ - одна строка, ответ - одна строка сразу после готовности;
+// документ с serialization_settings загружает новую базу и подменяет ею текущую,
+// его запросы решаются уже по новой базе
+class RequestServer {
+public:
+    explicit RequestServer(std::shared_ptr<Snapshot> snapshot);
+
+    // документы из input до его конца, по порядку
+    void Serve(std::istream &input, std::ostream &output);
+
+    // документы из соединений с локальным сокетом socket_path; соединения обслуживаются
+    // параллельно, документы одного соединения - по порядку; ошибка запуска - исключение;
+    // SIGINT и SIGTERM завершают работу: при любом выходе сокет закрывается и удаляется,
+    // а уже полученные документы открытых соединений дообслуживаются
+    void ServeSocket(const std::string &socket_path);
+
+private:
+    // текущая база, читается и подменяется только через std::atomic_load и std::atomic_store:
+    // загрузка новой идёт без блокировок, запрос держит ссылку на свою базу до записи ответа,
+    // старая база освобождается последним из них
+    std::shared_ptr<Snapshot> snapshot_;
+
+    // snapshot - база запроса, после подмены - новая;
+    // пустая строка - без ответа; ошибка в документе - ответ с error_message
+    std::optional<std::string> Answer(std::string_view line, std::shared_ptr<Snapshot> &snapshot);
+
+    // соединение закрывает вызывающий
+    void ServeConnection(int fd);
+};
+
+}  // namespace server
@@ -1,13 +1,24 @@
 #pragma once
 
+#include "flat_base.h"
 #include "graph.h"
+#include "thread_pool.h"
 
 #include <algorithm>
+#include <atomic>
+#include <bitset>
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <queue>
 #include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -15,156 +26,786 @@
 
 namespace graph {
 
-template <typename Weight>
-class Router {
-private:
-    using Graph = DirectedWeightedGraph<Weight>;
+// счётчики поисков по запросу: число поисков и раскрытых (settled) вершин;
+// baseline_settled_vertices - те же поиски без эвристики, если их подсчёт включён
+struct SearchStats {
+    size_t searches = 0;
+    size_t settled_vertices = 0;
+    size_t baseline_settled_vertices = 0;
+};
 
+// интерфейсный класс - маршрутизатор по графу
+template <typename Weight>
+class IRouter {
 public:
-    explicit Router(const Graph& graph);
-
     struct RouteInfo {
         Weight weight;
         std::vector<EdgeId> edges;
     };
 
-    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+    virtual std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const = 0;
+
+    // маршруты из одной вершины до нескольких, по умолчанию - поиск на каждую пару
+    virtual std::vector<std::optional<RouteInfo>> BuildRoutes(VertexId from, const std::vector<VertexId>& to) const {
+        std::vector<std::optional<RouteInfo>> routes;
+        routes.reserve(to.size());
+        for (VertexId vertex : to) {
+            routes.push_back(BuildRoute(from, vertex));
+        }
+        return routes;
+    }
+
+    // веса маршрутов всех пар from x to без восстановления рёбер, строка на каждую вершину from;
+    // по умолчанию - по одному поиску BuildRoutes на каждую вершину from
+    virtual std::vector<std::vector<std::optional<Weight>>> BuildWeightMatrix(const std::vector<VertexId>& from,
+                                                                              const std::vector<VertexId>& to) const {
+        std::vector<std::vector<std::optional<Weight>>> matrix;
+        matrix.reserve(from.size());
+        for (VertexId vertex : from) {
+            auto& row = matrix.emplace_back();
+            row.reserve(to.size());
+            for (const auto& route : BuildRoutes(vertex, to)) {
+                row.push_back(route ? std::optional<Weight>(route->weight) : std::nullopt);
+            }
+        }
+        return matrix;
+    }
+
+    virtual void Serialize(transport_router_serialize::TransportRouter &serialData) const = 0;
+    virtual void Deserialize(const transport_router_serialize::TransportRouter &serialData) = 0;
+
+    // потоковая запись: заголовок без больших массивов, затем сами массивы кусками;
+    // слияние кусков с заголовком (MergeFrom) даёт то же, что Serialize
+    using ChunkWriter = std::function<void(const transport_router_serialize::TransportRouter&)>;
+    virtual void SerializeHead(transport_router_serialize::TransportRouter &serialData) const {
+        Serialize(serialData);
+    }
+    virtual void SerializeChunks(const ChunkWriter& /*write_chunk*/) const {
+    }
+
+    // потоковая загрузка: Deserialize заголовка, куски по порядку записи,
+    // затем FinishChunks проверяет, что данные получены полностью
+    virtual void DeserializeChunk(const transport_router_serialize::TransportRouter& /*chunk*/) {
+        throw std::runtime_error("Router data is not chunked");
+    }
+    virtual void FinishChunks() {
+    }
+
+    // данные для плоской базы, которые читаются прямо из отображения файла;
+    // false - таких данных нет, маршрутизатор сохраняется и загружается через Serialize
+    virtual bool SaveSections(flat::BaseWriter& /*writer*/) const {
+        return false;
+    }
+    virtual bool LoadSections(const flat::BaseReader& /*reader*/) {
+        return false;
+    }
+
+    // маршрутизаторы с предрасчётом поисков не ведут
+    virtual SearchStats GetSearchStats() const {
+        return {};
+    }
+    // поиск с эвристикой дополнительно повторяется без неё для сравнения числа вершин
+    virtual void SetBaselineStats(bool /*enabled*/) {
+    }
+
+    // учёт изменений уже обновлённого графа; поиску по запросу обновлять нечего
+    virtual void UpdateRoutes(const std::vector<EdgeId>& /*added_edges*/, const std::vector<EdgeId>& /*removed_edges*/) {
+    }
+
+    virtual ~IRouter() = default;
+};
+
+// маршрутизатор с предрасчётом всех пар вершин (Флойд - Уоршелл)
+template <typename Weight>
+class Router: public IRouter<Weight> {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    using typename IRouter<Weight>::RouteInfo;
+
+    // thread_count - число потоков для построения таблицы (0 - по числу ядер)
+    explicit Router(const Graph& graph, size_t thread_count = 0);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const override;
+    // веса берутся прямо из таблицы
+    std::vector<std::vector<std::optional<Weight>>> BuildWeightMatrix(const std::vector<VertexId>& from,
+                                                                      const std::vector<VertexId>& to) const override;
+    
+    void Serialize(transport_router_serialize::TransportRouter &serialData) const override;
+    void Deserialize(const transport_router_serialize::TransportRouter &serialData) override;
     
+    // куски - строки таблицы подряд, около CHUNK_CELL_COUNT ячеек в каждом
+    void SerializeHead(transport_router_serialize::TransportRouter &serialData) const override;
+    void SerializeChunks(const typename IRouter<Weight>::ChunkWriter& write_chunk) const override;
+    void DeserializeChunk(const transport_router_serialize::TransportRouter& chunk) override;
+    void FinishChunks() override;
     
-    void Serialize(transport_router_serialize::TransportRouter &serialData) const;
-    void Deserialize(const transport_router_serialize::TransportRouter &serialData);
+    // таблица пишется двумя массивами и при загрузке не копируется:
+    // запросы читают её из отображения файла, пока таблицу не потребуется изменить
+    bool SaveSections(flat::BaseWriter& writer) const override;
+    bool LoadSections(const flat::BaseReader& reader) override;
     
+    // добавленные рёбра учитываются релаксацией таблицы через их концы,
+    // строки с маршрутами через удалённые рёбра пересчитываются Дейкстрой
+    void UpdateRoutes(const std::vector<EdgeId>& added_edges, const std::vector<EdgeId>& removed_edges) override;
 
 private:
-    struct RouteInternalData {
-        Weight weight;
-        std::optional<EdgeId> prev_edge;
+    // компактный номер ребра в таблице
+    using TableEdgeId = std::uint32_t;
+
+    // таблица V x V одним куском: веса и последние рёбра маршрутов в отдельных массивах,
+    // недостижимость и отсутствие ребра кодируются значениями UNREACHABLE_WEIGHT и NO_EDGE
+    struct RoutesTable {
+        std::vector<Weight> weights;
+        std::vector<TableEdgeId> prev_edges;
+
+        RoutesTable() = default;
+        explicit RoutesTable(size_t cell_count)
+            : weights(cell_count, UNREACHABLE_WEIGHT)
+            , prev_edges(cell_count, NO_EDGE) {
+        }
     };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
 
     void InitializeRoutesInternalData(const Graph& graph) {
-        const size_t vertex_count = graph.GetVertexCount();
-        for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-            routes_internal_data_[vertex][vertex] = RouteInternalData{ZERO_WEIGHT, std::nullopt};
-            for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
-                const auto& edge = graph.GetEdge(edge_id);
-                if (edge.weight < ZERO_WEIGHT) {
-                    throw std::domain_error("Edges' weights should be non-negative");
+        if (graph.GetEdgeCount() >= NO_EDGE) {
+            throw std::length_error("Too many edges for routes table");
+        }
+        for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+            const size_t route_index = vertex * vertex_count_ + vertex;
+            routes_.weights[route_index] = ZERO_WEIGHT;
+            if (graph.IsFrozen()) {
+                const auto arcs = graph.GetOutgoingArcs(vertex);
+                for (size_t i = 0; i < arcs.size; ++i) {
+                    InitializeRoute(vertex, arcs.vertices[i], arcs.weights[i], arcs.edge_ids[i]);
                 }
-                auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-                if (!route_internal_data || route_internal_data->weight > edge.weight) {
-                    route_internal_data = RouteInternalData{edge.weight, edge_id};
+            } else {
+                for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+                    const auto& edge = graph.GetEdge(edge_id);
+                    InitializeRoute(vertex, edge.to, edge.weight, edge_id);
                 }
             }
         }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to, const RouteInternalData& route_from,
-                    const RouteInternalData& route_to) {
-        auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-        const Weight candidate_weight = route_from.weight + route_to.weight;
-        if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-            route_relaxing = {candidate_weight,
-                              route_to.prev_edge ? route_to.prev_edge : route_from.prev_edge};
+    void InitializeRoute(VertexId vertex_from, VertexId vertex_to, Weight weight, EdgeId edge_id) {
+        if (weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+        const size_t index = vertex_from * vertex_count_ + vertex_to;
+        if (routes_.weights[index] == UNREACHABLE_WEIGHT || routes_.weights[index] > weight) {
+            routes_.weights[index] = weight;
+            routes_.prev_edges[index] = static_cast<TableEdgeId>(edge_id);
         }
     }
 
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
-        for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-            if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-                for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-                    if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-                        RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
+    void RelaxRoute(size_t index, Weight weight_from, TableEdgeId prev_edge_from,
+                    Weight weight_to, TableEdgeId prev_edge_to) {
+        const Weight candidate_weight = weight_from + weight_to;
+        if (routes_.weights[index] == UNREACHABLE_WEIGHT || candidate_weight < routes_.weights[index]) {
+            routes_.weights[index] = candidate_weight;
+            routes_.prev_edges[index] = prev_edge_to != NO_EDGE ? prev_edge_to : prev_edge_from;
+        }
+    }
+
+    // ведущие столбец и строка фазы: значения d[from][through] и d[through][to]
+    // на момент шага через through, как их видит последовательный алгоритм;
+    // с ними блоки дают ту же таблицу, что и обход по одной вершине
+    struct PivotData {
+        RoutesTable column;  // [vertex_from][through]
+        RoutesTable row;     // [through][vertex_to]
+    };
+
+    // релаксация блока строк block_from и столбцов block_to через вершины блока block_through
+    void RelaxBlock(size_t block_from, size_t block_to, size_t block_through, PivotData& pivot) {
+        const VertexId from_begin = block_from * BLOCK_SIZE;
+        const VertexId from_end = std::min(vertex_count_, from_begin + BLOCK_SIZE);
+        const VertexId to_begin = block_to * BLOCK_SIZE;
+        const VertexId to_end = std::min(vertex_count_, to_begin + BLOCK_SIZE);
+        const VertexId through_begin = block_through * BLOCK_SIZE;
+        const VertexId through_end = std::min(vertex_count_, through_begin + BLOCK_SIZE);
+
+        for (VertexId vertex_through = through_begin; vertex_through < through_end; ++vertex_through) {
+            const size_t pivot_index = vertex_through - through_begin;
+            const size_t pivot_row = pivot_index * vertex_count_;
+            // блок, содержащий ведущий столбец или строку, обновляет их копию
+            if (block_to == block_through) {
+                for (VertexId vertex_from = from_begin; vertex_from < from_end; ++vertex_from) {
+                    const size_t index = vertex_from * vertex_count_ + vertex_through;
+                    pivot.column.weights[vertex_from * BLOCK_SIZE + pivot_index] = routes_.weights[index];
+                    pivot.column.prev_edges[vertex_from * BLOCK_SIZE + pivot_index] = routes_.prev_edges[index];
+                }
+            }
+            if (block_from == block_through) {
+                const size_t row = vertex_through * vertex_count_;
+                std::copy(routes_.weights.begin() + row + to_begin, routes_.weights.begin() + row + to_end,
+                          pivot.row.weights.begin() + pivot_row + to_begin);
+                std::copy(routes_.prev_edges.begin() + row + to_begin, routes_.prev_edges.begin() + row + to_end,
+                          pivot.row.prev_edges.begin() + pivot_row + to_begin);
+            }
+
+            for (VertexId vertex_from = from_begin; vertex_from < from_end; ++vertex_from) {
+                const Weight weight_from = pivot.column.weights[vertex_from * BLOCK_SIZE + pivot_index];
+                if (weight_from == UNREACHABLE_WEIGHT) {
+                    continue;
+                }
+                const TableEdgeId prev_edge_from = pivot.column.prev_edges[vertex_from * BLOCK_SIZE + pivot_index];
+                const size_t row = vertex_from * vertex_count_;
+                for (VertexId vertex_to = to_begin; vertex_to < to_end; ++vertex_to) {
+                    const Weight weight_to = pivot.row.weights[pivot_row + vertex_to];
+                    if (weight_to != UNREACHABLE_WEIGHT) {
+                        RelaxRoute(row + vertex_to, weight_from, prev_edge_from,
+                                   weight_to, pivot.row.prev_edges[pivot_row + vertex_to]);
                     }
                 }
             }
         }
     }
+
+    // блочный Флойд - Уоршелл: на каждой фазе сначала диагональный блок,
+    // затем блоки его строки и столбца, затем все остальные;
+    // блоки второго и третьего этапов независимы и считаются параллельно
+    void RelaxRoutesInternalDataBlocked(size_t thread_count) {
+        const size_t block_count = (vertex_count_ + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        parallel::ThreadPool pool(thread_count);
+        PivotData pivot{RoutesTable(vertex_count_ * BLOCK_SIZE), RoutesTable(BLOCK_SIZE * vertex_count_)};
+
+        for (size_t block_through = 0; block_through < block_count; ++block_through) {
+            RelaxBlock(block_through, block_through, block_through, pivot);
+
+            pool.ParallelFor(2 * block_count, [&](size_t task) {
+                const size_t block = task / 2;
+                if (block == block_through) {
+                    return;
+                }
+                if (task % 2 == 0) {
+                    RelaxBlock(block_through, block, block_through, pivot);
+                } else {
+                    RelaxBlock(block, block_through, block_through, pivot);
+                }
+            });
+
+            pool.ParallelFor(block_count * block_count, [&](size_t task) {
+                const size_t block_from = task / block_count;
+                const size_t block_to = task % block_count;
+                if (block_from == block_through || block_to == block_through) {
+                    return;
+                }
+                RelaxBlock(block_from, block_to, block_through, pivot);
+            });
+        }
+    }
+    
+    // чтение таблицы: из отображения плоской базы или из routes_
+    Weight GetTableWeight(size_t index) const {
+        return mapped_weights_ != nullptr ? mapped_weights_[index] : routes_.weights[index];
+    }
+
+    TableEdgeId GetTablePrevEdge(size_t index) const {
+        return mapped_prev_edges_ != nullptr ? mapped_prev_edges_[index] : routes_.prev_edges[index];
+    }
+
+    // таблица в формате прежних версий базы: сообщение на каждую ячейку
+    void DeserializeRowsTable(const transport_router_serialize::TransportRouter &serialData);
     
+    // разбор упакованных ячеек по битовой карте: подряд или независимыми отрезками кусков
+    void DecodeTableCells(const transport_router_serialize::RoutesTable &table_proto);
+    // значения [item_begin, item_end) - в достижимые ячейки с index, не дальше cell_end;
+    // результат - следующая ячейка и код последнего ребра
+    std::pair<size_t, int64_t> DecodeTableSegment(const transport_router_serialize::RoutesTable &table_proto,
+                                                  int item_begin, int item_end, size_t index, size_t cell_end,
+                                                  int64_t prev_code);
+
+    // копия таблицы из отображения файла перед её изменением
+    void DetachTable() {
+        if (mapped_weights_ == nullptr) {
+            return;
+        }
+        const size_t cell_count = vertex_count_ * vertex_count_;
+        routes_.weights.assign(mapped_weights_, mapped_weights_ + cell_count);
+        routes_.prev_edges.assign(mapped_prev_edges_, mapped_prev_edges_ + cell_count);
+        mapped_weights_ = nullptr;
+        mapped_prev_edges_ = nullptr;
+        mapped_file_.reset();
+    }
+
+    // расширение таблицы под новые вершины графа
+    void ResizeTable(size_t vertex_count) {
+        RoutesTable routes(vertex_count * vertex_count);
+        for (VertexId vertex_from = 0; vertex_from < vertex_count_; ++vertex_from) {
+            const size_t row = vertex_from * vertex_count_;
+            std::copy(routes_.weights.begin() + row, routes_.weights.begin() + row + vertex_count_,
+                      routes.weights.begin() + vertex_from * vertex_count);
+            std::copy(routes_.prev_edges.begin() + row, routes_.prev_edges.begin() + row + vertex_count_,
+                      routes.prev_edges.begin() + vertex_from * vertex_count);
+        }
+        for (VertexId vertex = vertex_count_; vertex < vertex_count; ++vertex) {
+            routes.weights[vertex * vertex_count + vertex] = ZERO_WEIGHT;
+        }
+        routes_ = std::move(routes);
+        vertex_count_ = vertex_count;
+    }
+
+    // релаксация всех пар через концы новых рёбер: любой новый кратчайший путь
+    // состоит из старых кратчайших путей между этими вершинами и новых рёбер
+    void RelaxThroughEdges(const std::vector<EdgeId>& added_edges, parallel::ThreadPool& pool) {
+        std::vector<VertexId> pivots;
+        for (const EdgeId edge_id : added_edges) {
+            if (graph_.IsEdgeRemoved(edge_id)) {
+                continue;
+            }
+            const auto& edge = graph_.GetEdge(edge_id);
+            InitializeRoute(edge.from, edge.to, edge.weight, edge_id);
+            pivots.push_back(edge.from);
+            pivots.push_back(edge.to);
+        }
+        std::sort(pivots.begin(), pivots.end());
+        pivots.erase(std::unique(pivots.begin(), pivots.end()), pivots.end());
+
+        for (const VertexId vertex_through : pivots) {
+            // строка ведущей вершины через неё же не меняется, поэтому строки независимы
+            const size_t pivot_row = vertex_through * vertex_count_;
+            pool.ParallelFor(vertex_count_, [&](VertexId vertex_from) {
+                const size_t row = vertex_from * vertex_count_;
+                const Weight weight_from = routes_.weights[row + vertex_through];
+                if (weight_from == UNREACHABLE_WEIGHT) {
+                    return;
+                }
+                const TableEdgeId prev_edge_from = routes_.prev_edges[row + vertex_through];
+                for (VertexId vertex_to = 0; vertex_to < vertex_count_; ++vertex_to) {
+                    const Weight weight_to = routes_.weights[pivot_row + vertex_to];
+                    if (weight_to != UNREACHABLE_WEIGHT) {
+                        RelaxRoute(row + vertex_to, weight_from, prev_edge_from,
+                                   weight_to, routes_.prev_edges[pivot_row + vertex_to]);
+                    }
+                }
+            });
+        }
+    }
+
+    // пересчёт строк, в дереве маршрутов которых есть удалённые рёбра
+    void RecomputeAffectedRows(const std::vector<EdgeId>& removed_edges, parallel::ThreadPool& pool) {
+        std::vector<bool> is_removed(graph_.GetEdgeCount(), false);
+        for (const EdgeId edge_id : removed_edges) {
+            is_removed.at(edge_id) = true;
+        }
+        pool.ParallelFor(vertex_count_, [&](VertexId vertex_from) {
+            if (RowUsesEdges(vertex_from, is_removed)) {
+                RecomputeRow(vertex_from);
+            }
+        });
+    }
+
+    // есть ли среди маршрутов строки проходящие через отмеченные рёбра:
+    // последние рёбра строки образуют дерево, отметка наследуется от предка
+    bool RowUsesEdges(VertexId vertex_from, const std::vector<bool>& is_marked) const {
+        enum class State : char { UNKNOWN, CLEAN, MARKED };
+        std::vector<State> states(vertex_count_, State::UNKNOWN);
+        std::vector<VertexId> chain;
+        const size_t row = vertex_from * vertex_count_;
+        for (VertexId vertex_to = 0; vertex_to < vertex_count_; ++vertex_to) {
+            VertexId vertex = vertex_to;
+            State state = State::CLEAN;
+            while (states[vertex] == State::UNKNOWN) {
+                const TableEdgeId edge_id = routes_.prev_edges[row + vertex];
+                if (edge_id == NO_EDGE) {
+                    break;
+                }
+                chain.push_back(vertex);
+                if (is_marked[edge_id]) {
+                    state = State::MARKED;
+                    break;
+                }
+                vertex = graph_.GetEdge(edge_id).from;
+            }
+            if (states[vertex] != State::UNKNOWN) {
+                state = states[vertex];
+            }
+            for (const VertexId chain_vertex : chain) {
+                states[chain_vertex] = state;
+            }
+            chain.clear();
+            if (state == State::MARKED) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // строка таблицы заново: дерево кратчайших путей Дейкстры из vertex_from
+    void RecomputeRow(VertexId vertex_from) {
+        using QueueItem = std::pair<Weight, VertexId>;
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+        const size_t row = vertex_from * vertex_count_;
+        std::fill(routes_.weights.begin() + row, routes_.weights.begin() + row + vertex_count_, UNREACHABLE_WEIGHT);
+        std::fill(routes_.prev_edges.begin() + row, routes_.prev_edges.begin() + row + vertex_count_, NO_EDGE);
+        routes_.weights[row + vertex_from] = ZERO_WEIGHT;
+        queue.push({ZERO_WEIGHT, vertex_from});
+        while (!queue.empty()) {
+            const auto [weight, vertex] = queue.top();
+            queue.pop();
+            if (weight > routes_.weights[row + vertex]) {
+                continue;
+            }
+            const auto arcs = graph_.GetOutgoingArcs(vertex);
+            for (size_t i = 0; i < arcs.size; ++i) {
+                const size_t index = row + arcs.vertices[i];
+                const Weight candidate_weight = weight + arcs.weights[i];
+                if (routes_.weights[index] == UNREACHABLE_WEIGHT || candidate_weight < routes_.weights[index]) {
+                    routes_.weights[index] = candidate_weight;
+                    routes_.prev_edges[index] = static_cast<TableEdgeId>(arcs.edge_ids[i]);
+                    queue.push({candidate_weight, arcs.vertices[i]});
+                }
+            }
+        }
+    }
+
     static constexpr Weight ZERO_WEIGHT{};
+    static constexpr Weight UNREACHABLE_WEIGHT = std::numeric_limits<Weight>::max();
+    static constexpr TableEdgeId NO_EDGE = std::numeric_limits<TableEdgeId>::max();
+    static constexpr size_t BLOCK_SIZE = 64;
+    static constexpr size_t CHUNK_CELL_COUNT = 1 << 16;
     const Graph& graph_;
-    RoutesInternalData routes_internal_data_;
+    size_t vertex_count_;
+    size_t thread_count_;
+    RoutesTable routes_;
+    // таблица из плоской базы, файл держится отображённым, пока она используется
+    std::shared_ptr<const flat::MappedFile> mapped_file_;
+    const Weight* mapped_weights_ = nullptr;
+    const TableEdgeId* mapped_prev_edges_ = nullptr;
+    
+    // состояние загрузки упакованной таблицы: карта достижимых ячеек,
+    // следующая ячейка и код последнего ребра предыдущей достижимой ячейки
+    // (для таблиц без начала кусков), число уже разобранных значений
+    struct TableDecoder {
+        std::string reachable;
+        size_t index = 0;
+        int64_t prev_code = 0;
+        size_t decoded_count = 0;
+    };
+    std::optional<TableDecoder> decoder_;
 };
 
 template <typename Weight>
-Router<Weight>::Router(const Graph& graph)
+Router<Weight>::Router(const Graph& graph, size_t thread_count)
     : graph_(graph)
-    , routes_internal_data_(graph.GetVertexCount(),
-                            std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+    , vertex_count_(graph.GetVertexCount())
+    , thread_count_(thread_count)
+    , routes_(vertex_count_ * vertex_count_)
 {
     InitializeRoutesInternalData(graph);
+    RelaxRoutesInternalDataBlocked(thread_count);
+}
 
-    const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-        RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+template <typename Weight>
+void Router<Weight>::UpdateRoutes(const std::vector<EdgeId>& added_edges, const std::vector<EdgeId>& removed_edges) {
+    if (!graph_.IsFrozen()) {
+        throw std::logic_error("Graph should be frozen before routing");
+    }
+    if (graph_.GetEdgeCount() >= NO_EDGE) {
+        throw std::length_error("Too many edges for routes table");
+    }
+    DetachTable();
+    if (graph_.GetVertexCount() > vertex_count_) {
+        ResizeTable(graph_.GetVertexCount());
+    }
+    parallel::ThreadPool pool(thread_count_);
+    // пересчитанные строки уже учитывают новые рёбра, релаксация их не ухудшит
+    if (!removed_edges.empty()) {
+        RecomputeAffectedRows(removed_edges, pool);
+    }
+    if (!added_edges.empty()) {
+        RelaxThroughEdges(added_edges, pool);
     }
 }
 
 template <typename Weight>
 std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
                                                                              VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_.at(from).at(to);
-    if (!route_internal_data) {
+    if (from >= vertex_count_ || to >= vertex_count_) {
+        throw std::out_of_range("Vertex is out of routes table");
+    }
+    const size_t row = from * vertex_count_;
+    const Weight weight = GetTableWeight(row + to);
+    if (weight == UNREACHABLE_WEIGHT) {
         return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
     std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-         edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge)
+    for (TableEdgeId edge_id = GetTablePrevEdge(row + to);
+         edge_id != NO_EDGE;
+         edge_id = GetTablePrevEdge(row + graph_.GetEdge(edge_id).from))
     {
-        edges.push_back(*edge_id);
+        edges.push_back(edge_id);
     }
     std::reverse(edges.begin(), edges.end());
 
     return RouteInfo{weight, std::move(edges)};
 }
 
+template <typename Weight>
+std::vector<std::vector<std::optional<Weight>>> Router<Weight>::BuildWeightMatrix(const std::vector<VertexId>& from,
+                                                                                  const std::vector<VertexId>& to) const {
+    std::vector<std::vector<std::optional<Weight>>> matrix(from.size(), std::vector<std::optional<Weight>>(to.size()));
+    for (size_t i = 0; i < from.size(); ++i) {
+        if (from[i] >= vertex_count_) {
+            throw std::out_of_range("Vertex is out of routes table");
+        }
+        const size_t row = from[i] * vertex_count_;
+        for (size_t j = 0; j < to.size(); ++j) {
+            if (to[j] >= vertex_count_) {
+                throw std::out_of_range("Vertex is out of routes table");
+            }
+            const Weight weight = GetTableWeight(row + to[j]);
+            if (weight != UNREACHABLE_WEIGHT) {
+                matrix[i][j] = weight;
+            }
+        }
+    }
+    return matrix;
+}
+    
+template <typename Weight>
+void Router<Weight>::Serialize(transport_router_serialize::TransportRouter &serialData) const {
+    SerializeHead(serialData);
+    SerializeChunks([&serialData](const transport_router_serialize::TransportRouter& chunk) {
+        serialData.MergeFrom(chunk);
+    });
+}
     
 template<>    
-inline void Router<double>::Serialize(transport_router_serialize::TransportRouter &serialData) const {
-    for (auto &row:routes_internal_data_) {
-        transport_router_serialize::RouteDataRow row_proto;
-        for (auto item:row) {
-            transport_router_serialize::RouteOptionalData item_proto;
-            if (item != std::nullopt) {
-                transport_router_serialize::RouteInternalData internal_proto;
-                internal_proto.set_weight(item->weight);
-                if (item->prev_edge != std::nullopt) {
-                    internal_proto.set_prev_edge(item->prev_edge.value());
-                }
-                *item_proto.mutable_data_value() = internal_proto;
-            }
-            *row_proto.add_row() = item_proto;
+inline void Router<double>::SerializeHead(transport_router_serialize::TransportRouter &serialData) const {
+    auto& table_proto = *serialData.mutable_routes_table();
+    const size_t cell_count = vertex_count_ * vertex_count_;
+    table_proto.set_vertex_count(static_cast<uint32_t>(vertex_count_));
+    std::string reachable((cell_count + 7) / 8, '\0');
+    for (size_t index = 0; index < cell_count; ++index) {
+        if (GetTableWeight(index) != UNREACHABLE_WEIGHT) {
+            reachable[index / 8] |= static_cast<char>(1 << (index % 8));
         }
-        *serialData.add_router_data() = row_proto;
     }
+    table_proto.set_reachable(std::move(reachable));
+}
     
+template<>    
+inline void Router<double>::SerializeChunks(const ChunkWriter& write_chunk) const {
+    const size_t rows_per_chunk = std::max<size_t>(1, CHUNK_CELL_COUNT / std::max<size_t>(1, vertex_count_));
+    // соседние ячейки строки часто достигаются через близкие рёбра, разности короче номеров
+    int64_t prev_code = 0;
+    uint64_t item_count = 0;
+    for (VertexId row_begin = 0; row_begin < vertex_count_; row_begin += rows_per_chunk) {
+        const VertexId row_end = std::min(vertex_count_, row_begin + rows_per_chunk);
+        transport_router_serialize::TransportRouter chunk;
+        auto& table_proto = *chunk.mutable_routes_table();
+        table_proto.add_chunk_first_cells(row_begin * vertex_count_);
+        table_proto.add_chunk_first_items(item_count);
+        table_proto.add_chunk_prev_codes(prev_code);
+        auto& weights = *table_proto.mutable_weights();
+        auto& prev_edge_deltas = *table_proto.mutable_prev_edge_deltas();
+        weights.Reserve(static_cast<int>((row_end - row_begin) * vertex_count_));
+        prev_edge_deltas.Reserve(static_cast<int>((row_end - row_begin) * vertex_count_));
+        for (size_t index = row_begin * vertex_count_; index < row_end * vertex_count_; ++index) {
+            const double weight = GetTableWeight(index);
+            if (weight == UNREACHABLE_WEIGHT) {
+                continue;
+            }
+            weights.AddAlreadyReserved(weight);
+            const TableEdgeId prev_edge = GetTablePrevEdge(index);
+            const int64_t code = prev_edge == NO_EDGE ? 0 : static_cast<int64_t>(prev_edge) + 1;
+            prev_edge_deltas.AddAlreadyReserved(code - prev_code);
+            prev_code = code;
+        }
+        item_count += weights.size();
+        write_chunk(chunk);
+    }
 }
     
 template<>    
 inline void Router<double>::Deserialize(const transport_router_serialize::TransportRouter &serialData) {
-    routes_internal_data_.clear();
+    mapped_weights_ = nullptr;
+    mapped_prev_edges_ = nullptr;
+    mapped_file_.reset();
+    decoder_.reset();
+    
+    if (!serialData.has_routes_table()) {
+        DeserializeRowsTable(serialData);
+        return;
+    }
+    
+    const auto& table_proto = serialData.routes_table();
+    vertex_count_ = table_proto.vertex_count();
+    if (vertex_count_ != graph_.GetVertexCount()) {
+        throw std::invalid_argument("Routes table does not match graph");
+    }
+    const size_t cell_count = vertex_count_ * vertex_count_;
+    if (table_proto.reachable().size() != (cell_count + 7) / 8) {
+        throw std::runtime_error("Routes table is corrupted");
+    }
+    routes_ = RoutesTable(cell_count);
+    decoder_ = TableDecoder{table_proto.reachable(), 0, 0, 0};
+    DecodeTableCells(table_proto);
+}
+    
+template <typename Weight>
+void Router<Weight>::DeserializeChunk(const transport_router_serialize::TransportRouter& chunk) {
+    if (!decoder_) {
+        throw std::runtime_error("Routes table chunk without table header");
+    }
+    DecodeTableCells(chunk.routes_table());
+}
+    
+template <typename Weight>
+void Router<Weight>::DecodeTableCells(const transport_router_serialize::RoutesTable &table_proto) {
+    const int item_count = table_proto.weights_size();
+    if (table_proto.prev_edge_deltas_size() != item_count) {
+        throw std::runtime_error("Routes table is corrupted");
+    }
+    const size_t cell_count = vertex_count_ * vertex_count_;
+    auto& decoder = *decoder_;
+    const int segment_count = table_proto.chunk_first_cells_size();
+    
+    // таблица без начала кусков разбирается подряд с места, где остановился предыдущий кусок
+    if (segment_count == 0) {
+        std::tie(decoder.index, decoder.prev_code) =
+            DecodeTableSegment(table_proto, 0, item_count, decoder.index, cell_count, decoder.prev_code);
+        decoder.decoded_count += item_count;
+        return;
+    }
+    
+    if (table_proto.chunk_first_items_size() != segment_count || table_proto.chunk_prev_codes_size() != segment_count) {
+        throw std::runtime_error("Routes table is corrupted");
+    }
+    // в отдельном куске номера значений сдвинуты на его начало, в слитой таблице сдвига нет
+    const uint64_t item_base = table_proto.chunk_first_items(0);
+    auto get_item_begin = [&](int segment) {
+        return segment < segment_count ? table_proto.chunk_first_items(segment) - item_base : static_cast<uint64_t>(item_count);
+    };
+    auto get_cell_begin = [&](int segment) {
+        return segment < segment_count ? table_proto.chunk_first_cells(segment) : static_cast<uint64_t>(cell_count);
+    };
+    for (int segment = 0; segment < segment_count; ++segment) {
+        if (get_item_begin(segment) > get_item_begin(segment + 1) || get_cell_begin(segment) > get_cell_begin(segment + 1)) {
+            throw std::runtime_error("Routes table is corrupted");
+        }
+    }
+    
+    // отрезки пишут в непересекающиеся ячейки и разбираются параллельно
+    auto decode_segment = [&](size_t segment) {
+        DecodeTableSegment(table_proto, static_cast<int>(get_item_begin(segment)), static_cast<int>(get_item_begin(segment + 1)),
+                           get_cell_begin(segment), get_cell_begin(segment + 1), table_proto.chunk_prev_codes(segment));
+    };
+    if (segment_count == 1) {
+        decode_segment(0);
+    } else {
+        std::atomic<bool> corrupted{false};
+        parallel::ThreadPool pool(thread_count_);
+        pool.ParallelFor(segment_count, [&](size_t segment) {
+            try {
+                decode_segment(segment);
+            } catch (const std::exception&) {
+                corrupted = true;
+            }
+        });
+        if (corrupted) {
+            throw std::runtime_error("Routes table is corrupted");
+        }
+    }
+    decoder.decoded_count += item_count;
+}
+    
+template <typename Weight>
+std::pair<size_t, int64_t> Router<Weight>::DecodeTableSegment(const transport_router_serialize::RoutesTable &table_proto,
+                                                              int item_begin, int item_end, size_t index, size_t cell_end,
+                                                              int64_t prev_code) {
+    const std::string& reachable = decoder_->reachable;
+    for (int item = item_begin; item < item_end; ++item) {
+        while (index < cell_end && (reachable[index / 8] & (1 << (index % 8))) == 0) {
+            ++index;
+        }
+        if (index >= cell_end) {
+            throw std::runtime_error("Routes table is corrupted");
+        }
+        const int64_t code = prev_code + table_proto.prev_edge_deltas(item);
+        if (code < 0 || code > NO_EDGE) {
+            throw std::runtime_error("Routes table is corrupted");
+        }
+        routes_.weights[index] = table_proto.weights(item);
+        routes_.prev_edges[index] = code == 0 ? NO_EDGE : static_cast<TableEdgeId>(code - 1);
+        prev_code = code;
+        ++index;
+    }
+    return {index, prev_code};
+}
+    
+template <typename Weight>
+void Router<Weight>::FinishChunks() {
+    if (!decoder_) {
+        return;
+    }
+    size_t reachable_count = 0;
+    for (const char bits : decoder_->reachable) {
+        reachable_count += std::bitset<8>(static_cast<unsigned char>(bits)).count();
+    }
+    if (reachable_count != decoder_->decoded_count) {
+        throw std::runtime_error("Routes table is incomplete");
+    }
+    decoder_.reset();
+}
+    
+template <typename Weight>
+void Router<Weight>::DeserializeRowsTable(const transport_router_serialize::TransportRouter &serialData) {
+    vertex_count_ = serialData.router_data_size();
+    if (vertex_count_ != graph_.GetVertexCount()) {
+        throw std::invalid_argument("Routes table does not match graph");
+    }
+    routes_ = RoutesTable(vertex_count_ * vertex_count_);
     
     for (int i = 0; i < serialData.router_data_size(); i++) {
-        std::vector<std::optional<RouteInternalData>> row;
-        for (int j = 0; j < serialData.router_data(i).row_size(); j++) {
-            if (serialData.router_data(i).row(j).data_case() == transport_router_serialize::RouteOptionalData::DataCase::kDataValue) {
-                RouteInternalData value;
-                
-                value.weight = serialData.router_data(i).row(j).data_value().weight();
-                if (serialData.router_data(i).row(j).data_value().data_case() == transport_router_serialize::RouteInternalData::DataCase::kPrevEdge) {
-                    value.prev_edge = serialData.router_data(i).row(j).data_value().prev_edge();
+        const auto& row_proto = serialData.router_data(i);
+        // таблица квадратная: строка другой длины писала бы за пределы таблицы
+        if (static_cast<size_t>(row_proto.row_size()) != vertex_count_) {
+            throw std::runtime_error("Routes table is corrupted");
+        }
+        for (int j = 0; j < row_proto.row_size(); j++) {
+            if (row_proto.row(j).data_case() == transport_router_serialize::RouteOptionalData::DataCase::kDataValue) {
+                const size_t index = i * vertex_count_ + j;
+                routes_.weights[index] = row_proto.row(j).data_value().weight();
+                if (row_proto.row(j).data_value().data_case() == transport_router_serialize::RouteInternalData::DataCase::kPrevEdge) {
+                    routes_.prev_edges[index] = row_proto.row(j).data_value().prev_edge();
                 }
-                
-                row.push_back(value);
-            } else {
-                row.push_back(std::nullopt);
             }
         }
-        routes_internal_data_.push_back(row);
     }
 }
     
     
+template <typename Weight>
+bool Router<Weight>::SaveSections(flat::BaseWriter& writer) const {
+    static_assert(std::is_same_v<Weight, double>, "Flat base stores double weights");
+    const size_t cell_count = vertex_count_ * vertex_count_;
+    writer.AddArrayView(flat::SectionId::ROUTES_WEIGHTS,
+                        mapped_weights_ != nullptr ? mapped_weights_ : routes_.weights.data(), cell_count);
+    writer.AddArrayView(flat::SectionId::ROUTES_PREV_EDGES,
+                        mapped_prev_edges_ != nullptr ? mapped_prev_edges_ : routes_.prev_edges.data(), cell_count);
+    return true;
+}
+
+template <typename Weight>
+bool Router<Weight>::LoadSections(const flat::BaseReader& reader) {
+    if (!reader.HasSection(flat::SectionId::ROUTES_WEIGHTS)) {
+        return false;
+    }
+    const auto weights = reader.GetArray<Weight>(flat::SectionId::ROUTES_WEIGHTS);
+    const auto prev_edges = reader.GetArray<TableEdgeId>(flat::SectionId::ROUTES_PREV_EDGES);
+    vertex_count_ = graph_.GetVertexCount();
+    if (weights.size != vertex_count_ * vertex_count_ || prev_edges.size != weights.size) {
+        throw std::invalid_argument("Routes table does not match graph");
+    }
+    routes_ = RoutesTable();
+    decoder_.reset();
+    mapped_file_ = reader.GetFile();
+    mapped_weights_ = weights.data;
+    mapped_prev_edges_ = prev_edges.data;
+    return true;
+}
+    
 }  // namespace graph
\ No newline at end of file
@@ -1,8 +1,21 @@
 #include "serialization.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <deque>
 #include <fstream>
+#include <future>
+#include <limits>
+#include <unordered_set>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <transport_router.pb.h>
 
+#include "thread_pool.h"
+
 using namespace std;
 
 namespace serialization {
@@ -11,6 +24,11 @@ void TransportCatalogSerialization::Reset() {
     stop_id.clear();
     id_stop.clear();
     catalog_proto.Clear();
+    catalog_fingerprint = 0;
+}
+
+uint64_t TransportCatalogSerialization::GetBaseFingerprint(const transport_cataloge::TransportCatalogue &catalog) const {
+    return catalog_fingerprint != 0 ? catalog_fingerprint : catalog.GetFingerprint();
 }
     
 transport_catalogue_serialize::Coordinates TransportCatalogSerialization::CoordToProto(const geo::Coordinates &coord) const {
@@ -46,24 +64,6 @@ transport_catalogue_serialize::Bus TransportCatalogSerialization::GetProtoBus(do
     return result;
 }    
 
- domain::RoutesStop TransportCatalogSerialization::GetStopRouteFromProto(const transport_catalogue_serialize::Stop &stop_proto) {
-    domain::RoutesStop result;
-    result.Name = stop_proto.name();
-    result.Coord = ProtoToCoord(stop_proto.coord());
-    return result;
-}
-    
-domain::BusRoute TransportCatalogSerialization::GetBusRouteFromProto(const transport_catalogue_serialize::Bus &bus_proto) {
-    domain::BusRoute result;
-    result.Number = bus_proto.number();
-    result.IsLoop = bus_proto.is_loop();
-    int count = bus_proto.id_stops_size();
-    for (int i = 0; i < count; i++) {
-        result.Stops.push_back(string(id_stop[bus_proto.id_stops(i)]));
-    }
-    return result;
-}
-    
 void TransportCatalogSerialization::CatalogeToProto(const transport_cataloge::TransportCatalogue &catalog) {
     auto stops = catalog.GetListAllStops();
     auto buses = catalog.GetListAllBuses();
@@ -96,60 +96,238 @@ void TransportCatalogSerialization::CatalogeToProto(const transport_cataloge::Tr
     }
 }    
     
-bool TransportCatalogSerialization::SaveToFile(std::string fileName, const transport_cataloge::TransportCatalogue &catalog, const renderer::TransportCatalogeRendererSVG &render, const TransportRouter &router) {
+bool TransportCatalogSerialization::SaveToFile(std::string fileName, const transport_cataloge::TransportCatalogue &catalog, const renderer::TransportCatalogeRendererSVG &render, const TransportRouter &router,
+                                               BaseFormat format) {
     Reset();
+    if (format == BaseFormat::FLAT) {
+        return SaveFlatFile(fileName, catalog, render, router);
+    }
     try {
-        CatalogeToProto(catalog);
-        RendererToProto(render);
-        
-        transport_router_serialize::TransportRouter router_proto; 
-        router.Serialize(router_proto);
-        *catalog_proto.mutable_transport_router() = router_proto;
-        
-        ofstream ofs(fileName, ios::binary);
-        catalog_proto.SerializeToOstream(&ofs);
+        // прежняя база заменяется готовой: её могут читать через отображение файла
+        // работающие запросы, а маршрутизатор - копироваться из неё
+        const string outputName = fileName + ".tmp"s;
+        ofstream ofs(outputName, ios::binary);
+        {
+            google::protobuf::io::OstreamOutputStream zeroCopyOutput(&ofs);
+            google::protobuf::io::CodedOutputStream output(&zeroCopyOutput);
+            
+            // файл - одно сообщение Catalogue, записанное частями: повторы поля
+            // transport_router при разборе сливаются, куски таблицы дописываются к заголовку
+            CatalogeToProto(catalog);
+            RendererToProto(render);
+            catalog_proto.set_routing_fingerprint(routing_fingerprint);
+            catalog_proto.set_catalog_fingerprint(catalog.GetFingerprint());
+            catalog_proto.SerializeToCodedStream(&output);
+            catalog_proto.Clear();
+            
+            if (reused_router_base.empty()) {
+                transport_router_serialize::TransportRouter router_proto;
+                router.SerializeHead(router_proto);
+                WriteRouterChunk(router_proto, output);
+                router_proto.Clear();
+                router.SerializeChunks([&output](const transport_router_serialize::TransportRouter &chunk) {
+                    WriteRouterChunk(chunk, output);
+                });
+            }
+            if (output.HadError()) {
+                return false;
+            }
+        }
+        if (!reused_router_base.empty()) {
+            CopyProtoRouterData(ofs);
+        }
+        ofs.close();
+        return ofs && rename(outputName.c_str(), fileName.c_str()) == 0;
+    } catch (...) {
+        return false;
+    }
+    
+}
+
+void TransportCatalogSerialization::SetRoutingFingerprint(uint64_t fingerprint) {
+    routing_fingerprint = fingerprint;
+    reused_router_base.clear();
+}
+
+bool TransportCatalogSerialization::ReuseRouterFromFile(const std::string &fileName, BaseFormat format) {
+    reused_router_base.clear();
+    if (routing_fingerprint == 0) {
+        return false;
+    }
+    try {
+        const bool isFlat = flat::BaseReader::IsFlatBase(fileName);
+        if (isFlat != (format == BaseFormat::FLAT)) {
+            return false;
+        }
+        uint64_t fingerprint = 0;
+        if (isFlat) {
+            flat::BaseReader reader(fileName);
+            auto proto = reader.GetSection(flat::SectionId::PROTO);
+            transport_catalogue_serialize::Catalogue base_proto;
+            if (!base_proto.ParseFromArray(proto.data(), static_cast<int>(proto.size()))) {
+                return false;
+            }
+            fingerprint = base_proto.routing_fingerprint();
+        } else {
+            ifstream base(fileName, ios::binary);
+            uint64_t routerOffset;
+            if (!base || !FindProtoRouterData(base, fingerprint, routerOffset)) {
+                return false;
+            }
+        }
+        if (fingerprint != routing_fingerprint) {
+            return false;
+        }
+        reused_router_base = fileName;
         return true;
     } catch (...) {
         return false;
     }
+}
+
+bool TransportCatalogSerialization::FindProtoRouterData(std::istream &base, uint64_t &fingerprint, uint64_t &routerOffset) {
+    google::protobuf::io::IstreamInputStream zeroCopyInput(&base);
+    google::protobuf::io::CodedInputStream input(&zeroCopyInput);
+    input.SetTotalBytesLimit(numeric_limits<int>::max());
+    fingerprint = 0;
+    for (;;) {
+        const int position = input.CurrentPosition();
+        const uint32_t tag = input.ReadTag();
+        if (tag == 0 || tag == ROUTER_TAG) {
+            routerOffset = position;
+            return tag == ROUTER_TAG;
+        }
+        if (tag == FINGERPRINT_TAG) {
+            if (!input.ReadVarint64(&fingerprint)) {
+                return false;
+            }
+        } else if (!google::protobuf::internal::WireFormatLite::SkipField(&input, tag)) {
+            return false;
+        }
+    }
+}
+
+void TransportCatalogSerialization::CopyProtoRouterData(std::ostream &output) const {
+    ifstream base(reused_router_base, ios::binary);
+    uint64_t fingerprint;
+    uint64_t routerOffset;
+    if (!base || !FindProtoRouterData(base, fingerprint, routerOffset) || fingerprint != routing_fingerprint) {
+        throw runtime_error("Reused base has changed");
+    }
+    base.clear();
+    base.seekg(routerOffset);
+    output << base.rdbuf();
+}
+
+bool TransportCatalogSerialization::ReadLengthDelimited(google::protobuf::io::CodedInputStream &input, std::string &data) {
+    uint32_t length;
+    return input.ReadVarint32(&length) && input.ReadString(&data, static_cast<int>(length));
+}
+    
+void TransportCatalogSerialization::LoadProtoHead(const std::string &catalogData, const std::string &routerData, transport_cataloge::TransportCatalogue &catalog, renderer::TransportCatalogeRendererSVG &render, TransportRouter &router,
+                                                  LoadParts parts) {
+    // сообщения и строки базы размещаются в арене крупными блоками, а не по одному
+    google::protobuf::ArenaOptions options;
+    options.max_block_size = ARENA_MAX_BLOCK_SIZE;
+    google::protobuf::Arena arena(options);
+    auto *catalogProto = google::protobuf::Arena::CreateMessage<transport_catalogue_serialize::Catalogue>(&arena);
+    auto *routerProto = google::protobuf::Arena::CreateMessage<transport_router_serialize::TransportRouter>(&arena);
+    if (!catalogProto->ParseFromString(catalogData) || (parts.router && !routerProto->ParseFromString(routerData))) {
+        throw runtime_error("Base is corrupted");
+    }
+    ProtoToCatalog(*catalogProto, catalog);
+    catalog_fingerprint = catalogProto->catalog_fingerprint();
+    if (parts.renderer) {
+        ProtoToRenderer(*catalogProto, render);
+    }
+    if (parts.router) {
+        router.DeserializeHead(*routerProto);
+    }
+}
     
+void TransportCatalogSerialization::WriteRouterChunk(const transport_router_serialize::TransportRouter &chunk, google::protobuf::io::CodedOutputStream &output) {
+    output.WriteTag(ROUTER_TAG);
+    output.WriteVarint32(static_cast<uint32_t>(chunk.ByteSizeLong()));
+    chunk.SerializeWithCachedSizes(&output);
+}
+    
+bool TransportCatalogSerialization::CopyField(uint32_t tag, google::protobuf::io::CodedInputStream &input, google::protobuf::io::CodedOutputStream &output) {
+    output.WriteTag(tag);
+    switch (tag & 7) {
+        case 0: {
+            uint64_t value;
+            if (!input.ReadVarint64(&value)) {
+                return false;
+            }
+            output.WriteVarint64(value);
+            return true;
+        }
+        case 1: {
+            uint64_t value;
+            if (!input.ReadLittleEndian64(&value)) {
+                return false;
+            }
+            output.WriteLittleEndian64(value);
+            return true;
+        }
+        case 2: {
+            uint32_t length;
+            string bytes;
+            if (!input.ReadVarint32(&length) || !input.ReadString(&bytes, static_cast<int>(length))) {
+                return false;
+            }
+            output.WriteVarint32(length);
+            output.WriteString(bytes);
+            return true;
+        }
+        case 5: {
+            uint32_t value;
+            if (!input.ReadLittleEndian32(&value)) {
+                return false;
+            }
+            output.WriteLittleEndian32(value);
+            return true;
+        }
+        default:
+            return false;
+    }
 }
 
-void TransportCatalogSerialization::LoadStopsFromProto(transport_cataloge::TransportCatalogue &catalog) {
-    int count = catalog_proto.stops_size();
+void TransportCatalogSerialization::LoadStopsFromProto(const transport_catalogue_serialize::Catalogue &catalogProto, transport_cataloge::TransportCatalogue &catalog) {
+    int count = catalogProto.stops_size();
+    id_stop.assign(count, -1);
     for (int i = 0; i < count; i++) {
-        int id = catalog_proto.stops(i).id();
-        string_view name = catalog_proto.stops(i).name();
-        id_stop.insert({id, name});
-        auto stop = GetStopRouteFromProto(catalog_proto.stops(i));
-        catalog.AddStop(stop);
+        const auto &stop_proto = catalogProto.stops(i);
+        if (stop_proto.id() >= static_cast<uint32_t>(count)) {
+            throw out_of_range("Stop id is out of base");
+        }
+        id_stop[stop_proto.id()] = catalog.AddStopBulk(stop_proto.name(), ProtoToCoord(stop_proto.coord()));
     }
 }
     
-void TransportCatalogSerialization::LoadBusesFromProto(transport_cataloge::TransportCatalogue &catalog) {
-    int count = catalog_proto.buses_size();
-    for (int i = 0; i < count; i++) {
-        auto bus = GetBusRouteFromProto(catalog_proto.buses(i));
-        catalog.AddBus(bus);
+void TransportCatalogSerialization::LoadBusesFromProto(const transport_catalogue_serialize::Catalogue &catalogProto, transport_cataloge::TransportCatalogue &catalog) {
+    // номера остановок маршрута, буфер общий для всех маршрутов
+    vector<int> stopIndexes;
+    for (const auto &bus_proto:catalogProto.buses()) {
+        stopIndexes.clear();
+        for (auto id:bus_proto.id_stops()) {
+            stopIndexes.push_back(id_stop.at(id));
+        }
+        catalog.AddBusBulk(bus_proto.number(), bus_proto.is_loop(), stopIndexes);
     }
 }
     
-void TransportCatalogSerialization::LoadDistancesProto(transport_cataloge::TransportCatalogue &catalog) {
-    int count = catalog_proto.distances_size();
-    for (int i = 0; i < count; i++) {
-        //auto bus = GetBusRouteFromProto(catalog_proto.buses(i));
-        auto from_stop = id_stop[catalog_proto.distances(i).id_from()];
-        auto to_stop = id_stop[catalog_proto.distances(i).id_to()];
-        catalog.AddDistance(from_stop, to_stop, catalog_proto.distances(i).distance()
-        );
+void TransportCatalogSerialization::LoadDistancesProto(const transport_catalogue_serialize::Catalogue &catalogProto, transport_cataloge::TransportCatalogue &catalog) {
+    for (const auto &distance_proto:catalogProto.distances()) {
+        catalog.AddDistanceBulk(id_stop.at(distance_proto.id_from()), id_stop.at(distance_proto.id_to()), distance_proto.distance());
     }
 }    
     
-void TransportCatalogSerialization::ProtoToCatalog(transport_cataloge::TransportCatalogue &catalog) {
-    // считывание списка остановок в буфер
-    LoadStopsFromProto(catalog);
-    LoadBusesFromProto(catalog);
-    LoadDistancesProto(catalog);
+void TransportCatalogSerialization::ProtoToCatalog(const transport_catalogue_serialize::Catalogue &catalogProto, transport_cataloge::TransportCatalogue &catalog) {
+    catalog.ReserveBulk(catalogProto.stops_size(), catalogProto.buses_size());
+    LoadStopsFromProto(catalogProto, catalog);
+    LoadBusesFromProto(catalogProto, catalog);
+    LoadDistancesProto(catalogProto, catalog);
 } 
  
     
@@ -182,10 +360,10 @@ void TransportCatalogSerialization::RendererToProto(const renderer::TransportCat
     }
 }
     
-void TransportCatalogSerialization::ProtoToRenderer(renderer::TransportCatalogeRendererSVG &render) {
+void TransportCatalogSerialization::ProtoToRenderer(const transport_catalogue_serialize::Catalogue &catalogProto, renderer::TransportCatalogeRendererSVG &render) {
     
     renderer::RenderSettings settings;
-    auto rs = catalog_proto.render_settings();
+    const auto &rs = catalogProto.render_settings();
     
     settings.width = rs.width();
     settings.height = rs.height();
@@ -214,19 +392,89 @@ void TransportCatalogSerialization::ProtoToRenderer(renderer::TransportCatalogeR
     render.SetRenderSettings(settings);
 }
     
-bool TransportCatalogSerialization::LoadFromFile(std::string fileName, transport_cataloge::TransportCatalogue &catalog, renderer::TransportCatalogeRendererSVG &render, TransportRouter &router) {
+bool TransportCatalogSerialization::LoadFromFile(std::string fileName, transport_cataloge::TransportCatalogue &catalog, renderer::TransportCatalogeRendererSVG &render, TransportRouter &router,
+                                                 LoadParts parts) {
     Reset();
+    if (flat::BaseReader::IsFlatBase(fileName)) {
+        return LoadFlatFile(fileName, catalog, render, router, parts);
+    }
     try {
         ifstream ifs(fileName, ios::binary);
-        if (!catalog_proto.ParseFromIstream(&ifs)) {
+        if (!ifs) {
             return false;
         }
-        ProtoToCatalog(catalog);
-        ProtoToRenderer(render);
+        google::protobuf::io::IstreamInputStream zeroCopyInput(&ifs);
+        google::protobuf::io::CodedInputStream input(&zeroCopyInput);
+        input.SetTotalBytesLimit(numeric_limits<int>::max());
+        
+        // поля справочника копируются в буфер до первого поля transport_router;
+        // оно - заголовок маршрутизатора, следующие за ним - куски таблицы
+        string catalogData;
+        uint32_t tag;
+        {
+            google::protobuf::io::StringOutputStream zeroCopyCatalog(&catalogData);
+            google::protobuf::io::CodedOutputStream catalogOutput(&zeroCopyCatalog);
+            for (tag = input.ReadTag(); tag != 0 && tag != ROUTER_TAG; tag = input.ReadTag()) {
+                if (!CopyField(tag, input, catalogOutput)) {
+                    return false;
+                }
+            }
+        }
+        
+        if (!parts.router) {
+            LoadProtoHead(catalogData, {}, catalog, render, router, parts);
+            return true;
+        }
         
-        auto router_proto = catalog_proto.transport_router();
-        router.Deserialize(router_proto);
+        // справочник, граф и маршрутизаторы по заголовку строятся в пуле, пока читаются
+        // и разбираются куски таблицы; разобранные куски применяются по порядку,
+        // одновременно разбирается не больше chunkWindow кусков
+        future<void> headLoaded;
+        deque<future<transport_router_serialize::TransportRouter>> chunks;
+        parallel::ThreadPool pool;
+        const size_t chunkWindow = 2 * pool.GetThreadCount();
+        auto applyChunk = [&] {
+            if (headLoaded.valid()) {
+                headLoaded.get();
+            }
+            auto chunk = chunks.front().get();
+            chunks.pop_front();
+            router.DeserializeChunk(chunk);
+        };
         
+        string routerData;
+        if (tag == ROUTER_TAG && !ReadLengthDelimited(input, routerData)) {
+            return false;
+        }
+        headLoaded = pool.Submit([&, routerData = std::move(routerData)] {
+            LoadProtoHead(catalogData, routerData, catalog, render, router, parts);
+        });
+        for (tag = tag != 0 ? input.ReadTag() : 0; tag != 0; tag = input.ReadTag()) {
+            string chunkData;
+            if (tag != ROUTER_TAG || !ReadLengthDelimited(input, chunkData)) {
+                return false;
+            }
+            chunks.push_back(pool.Submit([chunkData = std::move(chunkData)] {
+                transport_router_serialize::TransportRouter chunk;
+                if (!chunk.ParseFromString(chunkData)) {
+                    throw runtime_error("Router data chunk is corrupted");
+                }
+                return chunk;
+            }));
+            if (chunks.size() >= chunkWindow) {
+                applyChunk();
+            }
+        }
+        while (!chunks.empty()) {
+            applyChunk();
+        }
+        if (headLoaded.valid()) {
+            headLoaded.get();
+        }
+        if (!input.ConsumedEntireMessage()) {
+            return false;
+        }
+        router.FinishChunks();
         return true;
     } catch (...) {
         return false;
@@ -234,4 +482,363 @@ bool TransportCatalogSerialization::LoadFromFile(std::string fileName, transport
     
 }     
     
+bool TransportCatalogSerialization::SavePatchToFile(std::string fileName, const transport_cataloge::TransportCatalogue &catalog, const domain::InputData &input) {
+    try {
+        transport_catalogue_serialize::Patch patch_proto;
+        patch_proto.set_base_stop_count(catalog.GetCountStops());
+        patch_proto.set_base_bus_count(catalog.GetCountBuses());
+        patch_proto.set_base_fingerprint(GetBaseFingerprint(catalog));
+        
+        // как и при заполнении справочника, из повторов остановок и маршрутов действует первый
+        unordered_map<string_view, int> newStops;
+        auto getStopIndex = [&](string_view name) {
+            int index = catalog.GetStopIndex(name);
+            if (index < 0) {
+                auto it = newStops.find(name);
+                if (it == newStops.end()) {
+                    throw invalid_argument("Unknown stop: "s + string(name));
+                }
+                index = it->second;
+            }
+            return index;
+        };
+        for (const auto &stop:input.ListStops) {
+            int index = catalog.GetStopIndex(stop.Name);
+            if (index >= 0) {
+                const auto &coord = catalog.FindStop(stop.Name)->Coord;
+                if (coord.lat == stop.Coord.lat && coord.lng == stop.Coord.lng) {
+                    continue;
+                }
+            } else if (newStops.count(stop.Name) == 0) {
+                index = catalog.GetCountStops() + newStops.size();
+                newStops.emplace(stop.Name, index);
+            } else {
+                continue;
+            }
+            auto *stop_proto = patch_proto.add_stops();
+            stop_proto->set_id(index);
+            stop_proto->set_name(stop.Name);
+            *stop_proto->mutable_coord() = CoordToProto(stop.Coord);
+        }
+        
+        const auto &distances = catalog.GetAllDistances();
+        for (const auto &stop:input.ListStops) {
+            for (const auto &[dest, distance]:stop.Distances) {
+                auto from = distances.find(stop.Name);
+                if (from != distances.end()) {
+                    auto to = from->second.find(dest);
+                    if (to != from->second.end() && to->second == distance) {
+                        continue;
+                    }
+                }
+                auto *distance_proto = patch_proto.add_distances();
+                distance_proto->set_id_from(getStopIndex(stop.Name));
+                distance_proto->set_id_to(getStopIndex(dest));
+                distance_proto->set_distance(distance);
+            }
+        }
+        
+        set<string_view> seenBuses;
+        for (const auto &bus:input.ListBuses) {
+            if (!seenBuses.insert(bus.Number).second) {
+                continue;
+            }
+            const domain::Bus *baseBus = catalog.FindBus(bus.Number);
+            if (baseBus != nullptr && baseBus->IsLoop == bus.IsLoop) {
+                auto busInfo = catalog.GetBusInfo(bus.Number);
+                if (equal(busInfo.StopNames.begin(), busInfo.StopNames.end(), bus.Stops.begin(), bus.Stops.end())) {
+                    continue;
+                }
+            }
+            auto *bus_proto = patch_proto.add_buses();
+            bus_proto->set_number(bus.Number);
+            bus_proto->set_is_loop(bus.IsLoop);
+            for (const auto &stop:bus.Stops) {
+                bus_proto->add_id_stops(getStopIndex(stop));
+            }
+        }
+        
+        ofstream ofs(fileName, ios::binary);
+        return patch_proto.SerializeToOstream(&ofs);
+    } catch (...) {
+        return false;
+    }
+}
+    
+bool TransportCatalogSerialization::ApplyPatchFromFile(std::string fileName, transport_cataloge::TransportCatalogue &catalog, TransportRouter &router,
+                                                       LoadParts parts) {
+    try {
+        ifstream ifs(fileName, ios::binary);
+        transport_catalogue_serialize::Patch patch_proto;
+        if (!ifs || !patch_proto.ParseFromIstream(&ifs)) {
+            return false;
+        }
+        ProtoToPatch(patch_proto, catalog, router, parts);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+    
+void TransportCatalogSerialization::ProtoToPatch(const transport_catalogue_serialize::Patch &patchProto, transport_cataloge::TransportCatalogue &catalog, TransportRouter &router,
+                                                 LoadParts parts) {
+    // правка записана для этого справочника; всё проверяется до изменений,
+    // чтобы неподходящая правка не оставила справочник изменённым наполовину
+    if (patchProto.base_stop_count() != static_cast<uint32_t>(catalog.GetCountStops())
+        || patchProto.base_bus_count() != static_cast<uint32_t>(catalog.GetCountBuses())
+        || patchProto.base_fingerprint() != GetBaseFingerprint(catalog)) {
+        throw invalid_argument("Patch does not match base");
+    }
+    const uint32_t baseStopCount = catalog.GetCountStops();
+    uint32_t stopCount = baseStopCount;
+    unordered_set<string_view> newStops;
+    for (const auto &stop_proto:patchProto.stops()) {
+        if (stop_proto.id() < baseStopCount) {
+            if (catalog.GetStopIndex(stop_proto.name()) != static_cast<int>(stop_proto.id())) {
+                throw invalid_argument("Patch does not match base");
+            }
+        } else if (stop_proto.id() != stopCount++ || catalog.GetStopIndex(stop_proto.name()) >= 0
+                   || !newStops.insert(stop_proto.name()).second) {
+            throw invalid_argument("Patch stops are inconsistent");
+        }
+    }
+    for (const auto &distance_proto:patchProto.distances()) {
+        if (distance_proto.id_from() >= stopCount || distance_proto.id_to() >= stopCount) {
+            throw invalid_argument("Patch distances are inconsistent");
+        }
+    }
+    for (const auto &bus_proto:patchProto.buses()) {
+        for (uint32_t id:bus_proto.id_stops()) {
+            if (id >= stopCount) {
+                throw invalid_argument("Patch buses are inconsistent");
+            }
+        }
+    }
+    
+    for (const auto &stop_proto:patchProto.stops()) {
+        if (stop_proto.id() < baseStopCount) {
+            catalog.SetStopCoordinates(stop_proto.id(), ProtoToCoord(stop_proto.coord()));
+        } else {
+            catalog.AddStopBulk(stop_proto.name(), ProtoToCoord(stop_proto.coord()));
+        }
+    }
+    
+    // пары остановок с изменённым расстоянием, без учёта направления
+    set<pair<int, int>> changedPairs;
+    for (const auto &distance_proto:patchProto.distances()) {
+        const int from = distance_proto.id_from();
+        const int to = distance_proto.id_to();
+        catalog.AddDistanceBulk(from, to, distance_proto.distance());
+        changedPairs.emplace(min(from, to), max(from, to));
+    }
+    
+    vector<string> changedBuses;
+    vector<int> stopIndexes;
+    for (const auto &bus_proto:patchProto.buses()) {
+        stopIndexes.assign(bus_proto.id_stops().begin(), bus_proto.id_stops().end());
+        catalog.SetBusRoute(bus_proto.number(), bus_proto.is_loop(), stopIndexes);
+        changedBuses.push_back(bus_proto.number());
+    }
+    
+    if (!parts.router) {
+        return;
+    }
+    for (auto &number:FindBusesByStopPairs(catalog, changedPairs)) {
+        if (find(changedBuses.begin(), changedBuses.end(), number) == changedBuses.end()) {
+            changedBuses.push_back(std::move(number));
+        }
+    }
+    if (!changedBuses.empty() || patchProto.stops_size() > 0) {
+        router.UpdateBuses(changedBuses);
+    }
+}
+    
+std::vector<std::string> TransportCatalogSerialization::FindBusesByStopPairs(const transport_cataloge::TransportCatalogue &catalog, const std::set<std::pair<int, int>> &stopPairs) const {
+    vector<string> result;
+    if (stopPairs.empty()) {
+        return result;
+    }
+    for (const auto &bus:catalog.GetListAllBuses()) {
+        auto busInfo = catalog.GetBusInfo(string(bus.Number));
+        int prevIndex = -1;
+        for (auto name:busInfo.StopNames) {
+            const int index = catalog.GetStopIndex(name);
+            if (prevIndex >= 0 && stopPairs.count({min(prevIndex, index), max(prevIndex, index)}) > 0) {
+                result.push_back(string(bus.Number));
+                break;
+            }
+            prevIndex = index;
+        }
+    }
+    return result;
+}
+    
+namespace {
+    
+// строки подряд и начала каждой строки (с концом последней)
+template <typename Strings>
+void AddStringSections(const Strings &strings, flat::SectionId namesId, flat::SectionId offsetsId, flat::BaseWriter &writer) {
+    string names;
+    vector<uint32_t> offsets = {0};
+    for (const auto &item:strings) {
+        names += item;
+        offsets.push_back(names.size());
+    }
+    writer.AddSection(namesId, names);
+    writer.AddArray(offsetsId, offsets);
+}
+    
+vector<string_view> GetStringSections(const flat::BaseReader &reader, flat::SectionId namesId, flat::SectionId offsetsId) {
+    string_view names = reader.GetSection(namesId);
+    auto offsets = reader.GetArray<uint32_t>(offsetsId);
+    vector<string_view> result;
+    for (size_t i = 0; i + 1 < offsets.size; i++) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > names.size()) {
+            throw runtime_error("Flat base strings are out of section");
+        }
+        result.push_back(names.substr(offsets[i], offsets[i + 1] - offsets[i]));
+    }
+    return result;
+}
+    
+} // namespace
+    
+void TransportCatalogSerialization::CatalogToSections(const transport_cataloge::TransportCatalogue &catalog, flat::BaseWriter &writer) {
+    auto stops = catalog.GetListAllStops();
+    auto buses = catalog.GetListAllBuses();
+    
+    vector<string_view> stopNames;
+    vector<flat::CoordinatesRecord> coords;
+    for (size_t i = 0; i < stops.size(); i++) {
+        stop_id.insert({stops[i].Name, static_cast<int>(i)});
+        stopNames.push_back(stops[i].Name);
+        coords.push_back({stops[i].Coord.lat, stops[i].Coord.lng});
+    }
+    AddStringSections(stopNames, flat::SectionId::STOP_NAMES, flat::SectionId::STOP_NAME_OFFSETS, writer);
+    writer.AddArray(flat::SectionId::STOP_COORDS, coords);
+    
+    vector<string_view> busNames;
+    vector<uint8_t> isLoop;
+    vector<uint32_t> stopOffsets = {0};
+    vector<uint32_t> busStops;
+    for (const auto &bus:buses) {
+        auto busInfo = catalog.GetBusInfo(string(bus.Number));
+        busNames.push_back(bus.Number);
+        isLoop.push_back(busInfo.IsLoop);
+        for (auto stopName:busInfo.StopNames) {
+            busStops.push_back(stop_id.at(stopName));
+        }
+        stopOffsets.push_back(busStops.size());
+    }
+    AddStringSections(busNames, flat::SectionId::BUS_NAMES, flat::SectionId::BUS_NAME_OFFSETS, writer);
+    writer.AddArray(flat::SectionId::BUS_IS_LOOP, isLoop);
+    writer.AddArray(flat::SectionId::BUS_STOP_OFFSETS, stopOffsets);
+    writer.AddArray(flat::SectionId::BUS_STOPS, busStops);
+    
+    vector<flat::DistanceRecord> distances;
+    for (const auto &[from, items]:catalog.GetAllDistances()) {
+        for (const auto &[to, distance]:items) {
+            distances.push_back({static_cast<uint32_t>(stop_id.at(from)), static_cast<uint32_t>(stop_id.at(to)), distance});
+        }
+    }
+    writer.AddArray(flat::SectionId::DISTANCES, distances);
+}
+    
+void TransportCatalogSerialization::SectionsToCatalog(const flat::BaseReader &reader, transport_cataloge::TransportCatalogue &catalog) {
+    auto stopNames = GetStringSections(reader, flat::SectionId::STOP_NAMES, flat::SectionId::STOP_NAME_OFFSETS);
+    auto coords = reader.GetArray<flat::CoordinatesRecord>(flat::SectionId::STOP_COORDS);
+    if (coords.size != stopNames.size()) {
+        throw runtime_error("Flat base stops are inconsistent");
+    }
+    auto busNames = GetStringSections(reader, flat::SectionId::BUS_NAMES, flat::SectionId::BUS_NAME_OFFSETS);
+    auto isLoop = reader.GetArray<uint8_t>(flat::SectionId::BUS_IS_LOOP);
+    auto stopOffsets = reader.GetArray<uint32_t>(flat::SectionId::BUS_STOP_OFFSETS);
+    auto busStops = reader.GetArray<uint32_t>(flat::SectionId::BUS_STOPS);
+    if (isLoop.size != busNames.size() || stopOffsets.size != busNames.size() + 1
+        || (stopOffsets.size > 0 && stopOffsets[stopOffsets.size - 1] > busStops.size)) {
+        throw runtime_error("Flat base buses are inconsistent");
+    }
+    
+    catalog.ReserveBulk(stopNames.size(), busNames.size());
+    for (size_t i = 0; i < stopNames.size(); i++) {
+        catalog.AddStopBulk(stopNames[i], {coords[i].lat, coords[i].lng});
+    }
+    
+    vector<int> stopIndexes;
+    for (size_t i = 0; i < busNames.size(); i++) {
+        if (stopOffsets[i] > stopOffsets[i + 1]) {
+            throw runtime_error("Flat base buses are inconsistent");
+        }
+        stopIndexes.assign(busStops.begin() + stopOffsets[i], busStops.begin() + stopOffsets[i + 1]);
+        catalog.AddBusBulk(busNames[i], isLoop[i] != 0, stopIndexes);
+    }
+    
+    for (const auto &distance:reader.GetArray<flat::DistanceRecord>(flat::SectionId::DISTANCES)) {
+        catalog.AddDistanceBulk(distance.from, distance.to, distance.distance);
+    }
+}
+    
+bool TransportCatalogSerialization::SaveFlatFile(const std::string &fileName, const transport_cataloge::TransportCatalogue &catalog, const renderer::TransportCatalogeRendererSVG &render, const TransportRouter &router) {
+    try {
+        flat::BaseWriter writer;
+        CatalogToSections(catalog, writer);
+        RendererToProto(render);
+        catalog_proto.set_routing_fingerprint(routing_fingerprint);
+        catalog_proto.set_catalog_fingerprint(catalog.GetFingerprint());
+        // прежняя база заменяется готовой, как и в формате protobuf
+        const string outputName = fileName + ".tmp"s;
+        if (reused_router_base.empty()) {
+            router.SaveSections(*catalog_proto.mutable_transport_router(), writer);
+            writer.AddSection(flat::SectionId::PROTO, catalog_proto.SerializeAsString());
+            return writer.WriteToFile(outputName) && rename(outputName.c_str(), fileName.c_str()) == 0;
+        }
+        // секции берутся из отображения прежней базы, оно живёт до конца записи
+        flat::BaseReader reader(reused_router_base);
+        CopyFlatRouterSections(reader, writer);
+        writer.AddSection(flat::SectionId::PROTO, catalog_proto.SerializeAsString());
+        return writer.WriteToFile(outputName) && rename(outputName.c_str(), fileName.c_str()) == 0;
+    } catch (...) {
+        return false;
+    }
+}
+
+void TransportCatalogSerialization::CopyFlatRouterSections(const flat::BaseReader &reader, flat::BaseWriter &writer) {
+    auto proto = reader.GetSection(flat::SectionId::PROTO);
+    transport_catalogue_serialize::Catalogue base_proto;
+    if (!base_proto.ParseFromArray(proto.data(), static_cast<int>(proto.size()))
+        || base_proto.routing_fingerprint() != routing_fingerprint) {
+        throw runtime_error("Reused base has changed");
+    }
+    *catalog_proto.mutable_transport_router() = std::move(*base_proto.mutable_transport_router());
+    // секции справочника - до DISTANCES включительно, дальше - маршрутизатора
+    for (auto id:reader.GetSectionIds()) {
+        if (static_cast<uint32_t>(id) > static_cast<uint32_t>(flat::SectionId::DISTANCES)) {
+            auto bytes = reader.GetSection(id);
+            writer.AddArrayView(id, bytes.data(), bytes.size());
+        }
+    }
+}
+
+bool TransportCatalogSerialization::LoadFlatFile(const std::string &fileName, transport_cataloge::TransportCatalogue &catalog, renderer::TransportCatalogeRendererSVG &render, TransportRouter &router,
+                                                 LoadParts parts) {
+    try {
+        flat::BaseReader reader(fileName);
+        auto proto = reader.GetSection(flat::SectionId::PROTO);
+        if (!catalog_proto.ParseFromArray(proto.data(), static_cast<int>(proto.size()))) {
+            return false;
+        }
+        SectionsToCatalog(reader, catalog);
+        catalog_fingerprint = catalog_proto.catalog_fingerprint();
+        if (parts.renderer) {
+            ProtoToRenderer(catalog_proto, render);
+        }
+        if (parts.router) {
+            router.LoadSections(catalog_proto.transport_router(), reader);
+        }
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+    
 } // end namespace serialization    
\ No newline at end of file
@@ -2,11 +2,15 @@
 
 #include <string>
 #include <string_view>
+#include <set>
+#include <utility>
 #include <vector>
 #include <unordered_map>
+#include <google/protobuf/io/coded_stream.h>
 #include <transport_catalogue.pb.h>
 
 #include "transport_catalogue.h"
+#include "flat_base.h"
 
 #include "geo.h"
 #include "domain.h"
@@ -26,17 +30,50 @@ struct Stop {
     geo::Coordinates Coord;
 };
     
+// части базы для загрузки, справочник загружается всегда
+struct LoadParts {
+    bool router = true;    // граф, маршрутизаторы и расписания
+    bool renderer = true;  // настройки отрисовки карты
+};
+    
+// формат файла базы
+enum class BaseFormat {
+    PROTOBUF,  // одно сообщение Catalogue
+    FLAT       // выровненные секции, читаются через отображение файла (flat_base.h)
+};
+    
 class TransportCatalogSerialization {
 public:
     TransportCatalogSerialization() = default;
     
-    bool SaveToFile(std::string fileName, const transport_cataloge::TransportCatalogue &catalog, const renderer::TransportCatalogeRendererSVG &render, const TransportRouter &router);
+    bool SaveToFile(std::string fileName, const transport_cataloge::TransportCatalogue &catalog, const renderer::TransportCatalogeRendererSVG &render, const TransportRouter &router,
+                    BaseFormat format = BaseFormat::PROTOBUF);
+    
+    // формат определяется по сигнатуре файла; ненужные части не разбираются,
+    // а маршрутизатор базы protobuf, записанный последним, и не читается
+    bool LoadFromFile(std::string fileName, transport_cataloge::TransportCatalogue &catalog, renderer::TransportCatalogeRendererSVG &render, TransportRouter &router,
+                      LoadParts parts = {});
+    
+    // отпечаток входных данных маршрутизатора для записи в базу (0 - нет)
+    void SetRoutingFingerprint(uint64_t fingerprint);
     
-    bool LoadFromFile(std::string fileName, transport_cataloge::TransportCatalogue &catalog, renderer::TransportCatalogeRendererSVG &render, TransportRouter &router);
+    // база fileName формата format записана с тем же отпечатком: тогда при записи её маршрутизатор
+    // копируется без разбора, и строить маршрутизатор не нужно
+    bool ReuseRouterFromFile(const std::string &fileName, BaseFormat format);
+    
+    // правка базы: отличия input от загруженного справочника - новые остановки и координаты,
+    // новые и изменённые расстояния, новые маршруты и маршруты с новым путём
+    bool SavePatchToFile(std::string fileName, const transport_cataloge::TransportCatalogue &catalog, const domain::InputData &input);
+    
+    // применение правки к загруженной базе; маршрутизатор, если загружен, пересчитывается
+    // только для изменённых маршрутов и маршрутов через изменённые расстояния
+    bool ApplyPatchFromFile(std::string fileName, transport_cataloge::TransportCatalogue &catalog, TransportRouter &router,
+                            LoadParts parts = {});
     //
 private:
     // буфер для остановок
-    std::unordered_map<int, std::string_view> id_stop;
+    // номер остановки в справочнике по её id в базе (id идут подряд)
+    std::vector<int> id_stop;
     std::unordered_map<std::string_view, int > stop_id;
     // буфер для маршрутов
     //std::vector<BusRoute> buses;
@@ -45,13 +82,47 @@ private:
     
     transport_catalogue_serialize::Catalogue catalog_proto;
     
+    uint64_t routing_fingerprint = 0;
+    // отпечаток справочника загруженной базы (0 - база записана без него)
+    uint64_t catalog_fingerprint = 0;
+    // база, из которой копируется маршрутизатор (пусто - записывается построенный)
+    std::string reused_router_base;
+    
     // сброс внутренних буферов
     void Reset();
     
+    // отпечаток справочника загруженной базы; у базы без записанного отпечатка - вычисленный
+    uint64_t GetBaseFingerprint(const transport_cataloge::TransportCatalogue &catalog) const;
+    
     void CatalogeToProto(const transport_cataloge::TransportCatalogue &catalog);
-    void ProtoToCatalog(transport_cataloge::TransportCatalogue &catalog);
+    void ProtoToCatalog(const transport_catalogue_serialize::Catalogue &catalogProto, transport_cataloge::TransportCatalogue &catalog);
+    
+    void ProtoToRenderer(const transport_catalogue_serialize::Catalogue &catalogProto, renderer::TransportCatalogeRendererSVG &render);
+    
+    // потоковая база protobuf: поле transport_router пишется и читается по кускам
+    static constexpr size_t ARENA_MAX_BLOCK_SIZE = 1 << 20;
+    static constexpr uint32_t ROUTER_TAG = (transport_catalogue_serialize::Catalogue::kTransportRouterFieldNumber << 3) | 2;
+    static void WriteRouterChunk(const transport_router_serialize::TransportRouter &chunk, google::protobuf::io::CodedOutputStream &output);
+    static bool ReadLengthDelimited(google::protobuf::io::CodedInputStream &input, std::string &data);
+    // справочник, настройки отрисовки и маршрутизатор без кусков таблицы
+    void LoadProtoHead(const std::string &catalogData, const std::string &routerData, transport_cataloge::TransportCatalogue &catalog, renderer::TransportCatalogeRendererSVG &render, TransportRouter &router,
+                       LoadParts parts);
+    // отпечаток и начало данных маршрутизатора базы protobuf, читается только справочник
+    static constexpr uint32_t FINGERPRINT_TAG = transport_catalogue_serialize::Catalogue::kRoutingFingerprintFieldNumber << 3;
+    static bool FindProtoRouterData(std::istream &base, uint64_t &fingerprint, uint64_t &routerOffset);
+    // маршрутизатор базы protobuf - её хвост, начиная с первого поля transport_router
+    void CopyProtoRouterData(std::ostream &output) const;
+    // маршрутизатор плоской базы - поле transport_router секции PROTO и секции после справочника
+    void CopyFlatRouterSections(const flat::BaseReader &reader, flat::BaseWriter &writer);
+    // перенос поля без разбора: тег уже прочитан из input
+    static bool CopyField(uint32_t tag, google::protobuf::io::CodedInputStream &input, google::protobuf::io::CodedOutputStream &output);
     
-    void ProtoToRenderer(renderer::TransportCatalogeRendererSVG &render);
+    // плоская база: справочник - массивами секций, остальное - в секции PROTO
+    bool SaveFlatFile(const std::string &fileName, const transport_cataloge::TransportCatalogue &catalog, const renderer::TransportCatalogeRendererSVG &render, const TransportRouter &router);
+    bool LoadFlatFile(const std::string &fileName, transport_cataloge::TransportCatalogue &catalog, renderer::TransportCatalogeRendererSVG &render, TransportRouter &router,
+                      LoadParts parts);
+    void CatalogToSections(const transport_cataloge::TransportCatalogue &catalog, flat::BaseWriter &writer);
+    void SectionsToCatalog(const flat::BaseReader &reader, transport_cataloge::TransportCatalogue &catalog);
     void RendererToProto(const renderer::TransportCatalogeRendererSVG &render);
     
     transport_catalogue_serialize::Coordinates CoordToProto(const geo::Coordinates &coord) const;
@@ -60,12 +131,14 @@ private:
     transport_catalogue_serialize::Stop GetProtoStop(int id_stop, domain::Stop &stop);
     transport_catalogue_serialize::Bus GetProtoBus(domain::BusInfo busInfo);
     
-    void LoadStopsFromProto(transport_cataloge::TransportCatalogue &catalog);
-    void LoadBusesFromProto(transport_cataloge::TransportCatalogue &catalog);
-    void LoadDistancesProto(transport_cataloge::TransportCatalogue &catalog);
+    void LoadStopsFromProto(const transport_catalogue_serialize::Catalogue &catalogProto, transport_cataloge::TransportCatalogue &catalog);
+    void LoadBusesFromProto(const transport_catalogue_serialize::Catalogue &catalogProto, transport_cataloge::TransportCatalogue &catalog);
+    void LoadDistancesProto(const transport_catalogue_serialize::Catalogue &catalogProto, transport_cataloge::TransportCatalogue &catalog);
     
-    domain::RoutesStop GetStopRouteFromProto(const transport_catalogue_serialize::Stop &stop_proto);
-    domain::BusRoute GetBusRouteFromProto(const transport_catalogue_serialize::Bus &bus_proto);
+    void ProtoToPatch(const transport_catalogue_serialize::Patch &patchProto, transport_cataloge::TransportCatalogue &catalog, TransportRouter &router,
+                      LoadParts parts);
+    // маршруты, в которых подряд идут остановки одной из пар
+    std::vector<std::string> FindBusesByStopPairs(const transport_cataloge::TransportCatalogue &catalog, const std::set<std::pair<int, int>> &stopPairs) const;
 };
     
 } // end namespace serialization
@@ -0,0 +1,29 @@
+#include "snapshot.h"
+
+#include <stdexcept>
+
+#include "json_reader.h"
+
+using namespace std;
+
+namespace server {
+
+Snapshot::Snapshot()
+    : renderer_(catalogue_)
+    , router_(catalogue_)
+    , handler_(catalogue_, renderer_, router_, serializator_) {
+}
+
+std::shared_ptr<Snapshot> Snapshot::Load(const json::Document &settings) {
+    auto snapshot = make_shared<Snapshot>();
+    if (!reader::JsonReader(settings).LoadFromFile(snapshot->handler_, serialization::LoadParts{})) {
+        throw runtime_error("Cannot load base");
+    }
+    return snapshot;
+}
+
+TransportCatalogeHandler& Snapshot::GetHandler() {
+    return handler_;
+}
+
+}  // namespace server
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+
+#include "json.h"
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "serialization.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+namespace server {
+
+// загруженная база: справочник, отрисовщик и маршрутизатор, связанные ссылками друг на друга;
+// после загрузки не меняется, поэтому запросы к ней идут без блокировок, а живёт она,
+// пока на неё есть ссылки - у сервера и у выполняющихся запросов
+class Snapshot {
+public:
+    Snapshot();
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // база и правка из serialization_settings документа settings, все части;
+    // ошибка загрузки - исключение
+    static std::shared_ptr<Snapshot> Load(const json::Document &settings);
+
+    // только для запросов: кэш маршрутов, который они меняют, защищён сам
+    TransportCatalogeHandler& GetHandler();
+
+private:
+    transport_cataloge::TransportCatalogue catalogue_;
+    renderer::TransportCatalogeRendererSVG renderer_;
+    TransportRouter router_;
+    serialization::TransportCatalogSerialization serializator_;
+    TransportCatalogeHandler handler_;
+};
+
+}  // namespace server
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+// пул потоков с общей очередью задач
+class ThreadPool {
+public:
+    // thread_count == 0 - по числу аппаратных потоков
+    explicit ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetThreadCount() const;
+
+    template <typename Func>
+    auto Submit(Func func) -> std::future<decltype(func())>;
+
+    // вызов func(i) для всех i из [0, count) с ожиданием завершения,
+    // вызывающий поток тоже участвует в работе
+    template <typename Func>
+    void ParallelFor(size_t count, Func func);
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_ = false;
+
+    void Work();
+};
+
+template <typename Func>
+auto ThreadPool::Submit(Func func) -> std::future<decltype(func())> {
+    using Result = decltype(func());
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(func));
+    std::future<Result> result = task->get_future();
+    if (workers_.empty()) {
+        (*task)();
+        return result;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push([task] { (*task)(); });
+    }
+    condition_.notify_one();
+    return result;
+}
+
+template <typename Func>
+void ThreadPool::ParallelFor(size_t count, Func func) {
+    if (count == 0) {
+        return;
+    }
+    if (workers_.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    // после ошибки номера больше не раздаются; выход только после завершения всех помощников,
+    // они обращаются к next_index и func этого кадра стека
+    std::atomic<size_t> next_index{0};
+    auto run = [&next_index, &func, count] {
+        try {
+            for (size_t i = next_index++; i < count; i = next_index++) {
+                func(i);
+            }
+        } catch (...) {
+            next_index = count;
+            throw;
+        }
+    };
+
+    const size_t helpers = std::min(workers_.size(), count - 1);
+    std::vector<std::future<void>> futures;
+    futures.reserve(helpers);
+    for (size_t i = 0; i < helpers; ++i) {
+        futures.push_back(Submit(run));
+    }
+    std::exception_ptr error;
+    try {
+        run();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (auto& future : futures) {
+        try {
+            future.get();
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}  // namespace parallel
@@ -1,5 +1,8 @@
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include "fingerprint.h"
 #include "transport_catalogue.h"
 
 using namespace std;
@@ -124,6 +127,90 @@ void TransportCatalogue::AddDistance(std::string_view src, std::string_view dest
         [IndexesStops.find(string(dest))->first] = distance;
 }
 
+void TransportCatalogue::ReserveBulk(size_t stopCount, size_t busCount) {
+    IndexesStops.reserve(stopCount);
+    IndexesBuses.reserve(busCount);
+    Buses_On_Stop.reserve(stopCount);
+    Routes.reserve(busCount);
+    Distances.reserve(stopCount);
+}
+
+int TransportCatalogue::AddStopBulk(std::string_view name, const geo::Coordinates &coord) {
+    int index = fStops.size();
+    auto [it, inserted] = IndexesStops.emplace(string(name), index);
+    if (!inserted) {
+        throw invalid_argument("Остановка повторяется: "s + it->first);
+    }
+    fStops.push_back({it->first, coord});
+    return index;
+}
+
+void TransportCatalogue::AddBusBulk(std::string_view number, bool isLoop, const std::vector<int> &stopIndexes) {
+    int index = fBuses.size();
+    auto [it, inserted] = IndexesBuses.emplace(string(number), index);
+    if (!inserted) {
+        throw invalid_argument("Маршрут повторяется: "s + it->first);
+    }
+    string_view busNumber = it->first;
+    fBuses.push_back({busNumber, isLoop});
+    
+    auto &route = Routes[busNumber];
+    route.reserve(stopIndexes.size());
+    for (int stopIndex:stopIndexes) {
+        Buses_On_Stop[GetStopBulk(stopIndex).Name].insert(busNumber);
+        route.push_back(stopIndex);
+    }
+}
+
+void TransportCatalogue::AddDistanceBulk(int src, int dest, int distance) {
+    Distances[GetStopBulk(src).Name][GetStopBulk(dest).Name] = distance;
+}
+
+void TransportCatalogue::SetStopCoordinates(int index, const geo::Coordinates &coord) {
+    GetStopBulk(index);
+    fStops[index].Coord = coord;
+}
+
+void TransportCatalogue::SetBusRoute(std::string_view number, bool isLoop, const std::vector<int> &stopIndexes) {
+    auto it = IndexesBuses.find(string(number));
+    if (it == IndexesBuses.end()) {
+        AddBusBulk(number, isLoop, stopIndexes);
+        return;
+    }
+    for (int stopIndex:stopIndexes) {
+        GetStopBulk(stopIndex);
+    }
+    string_view busNumber = it->first;
+    fBuses[it->second].IsLoop = isLoop;
+    
+    auto &route = Routes[busNumber];
+    for (int stopIndex:route) {
+        auto buses = Buses_On_Stop.find(fStops[stopIndex].Name);
+        if (buses != Buses_On_Stop.end()) {
+            buses->second.erase(busNumber);
+            if (buses->second.empty()) {
+                Buses_On_Stop.erase(buses);
+            }
+        }
+    }
+    route = stopIndexes;
+    for (int stopIndex:route) {
+        Buses_On_Stop[fStops[stopIndex].Name].insert(busNumber);
+    }
+}
+
+int TransportCatalogue::GetStopIndex(std::string_view Name) const {
+    auto it = IndexesStops.find(string(Name));
+    return it != IndexesStops.end() ? it->second : -1;
+}
+
+const domain::Stop& TransportCatalogue::GetStopBulk(int index) const {
+    if (index < 0 || static_cast<size_t>(index) >= fStops.size()) {
+        throw out_of_range("Нет остановки с номером "s + to_string(index));
+    }
+    return fStops[index];
+}
+
 bool TransportCatalogue::GetRawDistance(std::string_view src, std::string_view dest, int &result) const {
     auto it_src = Distances.find(src);
     if (it_src != Distances.end()) {
@@ -216,5 +303,46 @@ int TransportCatalogue::GetCountStops() const {
 const TransportCatalogue::DistancesInfo& TransportCatalogue::GetAllDistances() const {
     return Distances;
 }    
+
+uint64_t TransportCatalogue::GetFingerprint() const {
+    fingerprint::FingerprintBuilder builder;
+    auto allStops = GetListAllStops();
+    builder.Add(static_cast<uint64_t>(allStops.size()));
+    for (const auto &stop:allStops) {
+        builder.Add(stop.Name);
+        builder.Add(stop.Coord.lat);
+        builder.Add(stop.Coord.lng);
+    }
+    auto allBuses = GetListAllBuses();
+    builder.Add(static_cast<uint64_t>(allBuses.size()));
+    for (const auto &bus:allBuses) {
+        builder.Add(bus.Number);
+        builder.Add(bus.IsLoop);
+        auto route = Routes.find(bus.Number);
+        if (route == Routes.end()) {
+            builder.Add(uint64_t{0});
+            continue;
+        }
+        builder.Add(static_cast<uint64_t>(route->second.size()));
+        for (int stopIndex:route->second) {
+            builder.Add(fStops[stopIndex].Name);
+        }
+    }
+    
+    vector<tuple<string_view, string_view, int>> distances;
+    for (const auto &[from, destinations]:Distances) {
+        for (const auto &[to, distance]:destinations) {
+            distances.emplace_back(from, to, distance);
+        }
+    }
+    sort(distances.begin(), distances.end());
+    builder.Add(static_cast<uint64_t>(distances.size()));
+    for (const auto &[from, to, distance]:distances) {
+        builder.Add(from);
+        builder.Add(to);
+        builder.Add(distance);
+    }
+    return builder.Get();
+}
     
 } // конец namespace transport_cataloge    
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -35,6 +36,23 @@ public:
     
     void AddDistance(std::string_view src, std::string_view dest, int distance);
     
+    // массовая загрузка базы: таблицы выделяются заранее, маршруты и расстояния задаются
+    // номерами остановок в порядке добавления, поиска по названиям нет;
+    // повтор названия и неизвестный номер остановки - исключения
+    void ReserveBulk(size_t stopCount, size_t busCount);
+    // возвращает номер добавленной остановки
+    int AddStopBulk(std::string_view name, const geo::Coordinates &coord);
+    void AddBusBulk(std::string_view number, bool isLoop, const std::vector<int> &stopIndexes);
+    void AddDistanceBulk(int src, int dest, int distance);
+    
+    // правка загруженной базы по номерам остановок: новые координаты остановки,
+    // новый маршрут или новый путь существующего маршрута
+    void SetStopCoordinates(int index, const geo::Coordinates &coord);
+    void SetBusRoute(std::string_view number, bool isLoop, const std::vector<int> &stopIndexes);
+    
+    // номер остановки в порядке добавления (-1 - остановки нет)
+    int GetStopIndex(std::string_view Name) const;
+    
     // получение рассотяния по паре src и dest
     int GetDistance(std::string_view src, std::string_view dest) const;
     
@@ -47,6 +65,10 @@ public:
     
     int GetCountStops() const;
     
+    // отпечаток содержимого: остановки с координатами, маршруты и расстояния
+    // без учёта порядка добавления
+    uint64_t GetFingerprint() const;
+    
 private:
     // список остановок
     std::deque<domain::Stop> fStops;
@@ -81,6 +103,9 @@ private:
     // расчёт расстояния для маршрута Number как множества прямых отрезков
     double GetLinearDistance(std::string_view Number) const;
     
+    // остановка по номеру для массовой загрузки
+    const domain::Stop& GetStopBulk(int index) const;
+    
     // формирование структуры ParseStop на основе RoutesStop
     domain::Stop ParseStop(const domain::RoutesStop &stop);
     
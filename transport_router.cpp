@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <utility>
 #include <string>
+#include <tuple>
 #include <graph.pb.h>
 
+#include "fingerprint.h"
 #include "json_builder.h"
+#include "thread_pool.h"
 #include "transport_router.h"
 
 
@@ -13,14 +17,304 @@ namespace {
     int reverseIndex(int i, int n, bool reverse) {
         return reverse? n - 1 - i: i;
     }
+    
+    // увеличивается при изменении записи маршрутизатора в базе: старые базы не переиспользуются
+    const uint64_t FINGERPRINT_VERSION = 1;
+}
+
+void TransportRouter::BuildRouter(const RoutingSettings &settings) {
+    busVelocity = settings.bus_velocity * KmH_To_MMin;
+    busWaitTime = settings.bus_wait_time;
+    routerType = settings.router_type;
+    graphModel = settings.graph_model;
+    removedBuses.clear();
+    threadCount = settings.thread_count;
+    routeCache.SetCapacity(settings.route_cache_size);
+    BuildGraph();
 }
 
-void TransportRouter::BuildRouter(double bus_velocity ,int bus_wait_time) {
+void TransportRouter::BuildGraph() {
     graph = std::move(make_unique<graph::DirectedWeightedGraph<double>>(transportCatalogue.GetCountStops()));
-    busVelocity = bus_velocity * KmH_To_MMin;
-    busWaitTime = bus_wait_time;
+    routeCache.Clear();
     ScanTransportCatalogue();
-    router = std::move(make_unique<graph::Router<double>>(*graph));
+    graph->Freeze();
+    if (routerType == RouterType::ASTAR) {
+        BuildHeuristic();
+    }
+    CreateRouter();
+}
+
+void TransportRouter::SetTimetables(std::vector<domain::BusTimetable> newTimetables) {
+    timetables.clear();
+    for (auto &timetable:newTimetables) {
+        timetables[timetable.Number] = std::move(timetable.Departures);
+    }
+}
+
+void TransportRouter::AddBus(std::string_view busNumber) {
+    if (transportCatalogue.FindBus(busNumber) == nullptr) {
+        throw invalid_argument("Unknown bus: "s + string(busNumber));
+    }
+    // номера остановок - номера вершин графа и таблицы, новые остановки требуют полной сборки
+    if (static_cast<size_t>(transportCatalogue.GetCountStops()) != stops.size()) {
+        throw logic_error("New stops require a full router rebuild");
+    }
+    auto removed = removedBuses.find(busNumber);
+    if (indexBuses.count(busNumber) > 0 && removed == removedBuses.end()) {
+        throw invalid_argument("Bus is already routed: "s + string(busNumber));
+    }
+    if (removed != removedBuses.end()) {
+        removedBuses.erase(removed);
+    }
+    SyncBuses();
+    
+    if (routerType != RouterType::RAPTOR) {
+        vector<graph::EdgeId> addedEdges;
+        graph->Unfreeze();
+        AddBusEdges(busNumber, addedEdges);
+        graph->Freeze();
+        router->UpdateRoutes(addedEdges, {});
+    }
+    RebuildDerivedRouters();
+}
+
+void TransportRouter::RemoveBus(std::string_view busNumber) {
+    auto it = indexBuses.find(busNumber);
+    if (it == indexBuses.end() || removedBuses.count(busNumber) > 0) {
+        throw invalid_argument("Bus is not routed: "s + string(busNumber));
+    }
+    removedBuses.insert(string(busNumber));
+    
+    if (routerType != RouterType::RAPTOR) {
+        vector<graph::EdgeId> removedEdges;
+        graph->Unfreeze();
+        RemoveBusEdges(it->second, removedEdges);
+        graph->Freeze();
+        router->UpdateRoutes({}, removedEdges);
+    }
+    RebuildDerivedRouters();
+}
+
+void TransportRouter::UpdateBuses(const std::vector<std::string> &busNumbers) {
+    for (const auto &number:busNumbers) {
+        if (transportCatalogue.FindBus(number) == nullptr) {
+            throw invalid_argument("Unknown bus: "s + number);
+        }
+    }
+    // новые остановки сдвигают номера вершин: граф и таблица строятся заново
+    if (static_cast<size_t>(transportCatalogue.GetCountStops()) != stops.size()) {
+        BuildGraph();
+        return;
+    }
+    // названия остановок те же, могли измениться только координаты
+    stops = std::move(transportCatalogue.GetListAllStops());
+    
+    // исключённые автобусы остаются исключёнными, их рёбер в графе нет
+    vector<string_view> routedBuses;
+    for (const auto &number:busNumbers) {
+        if (removedBuses.count(number) == 0) {
+            routedBuses.push_back(number);
+        }
+    }
+    if (routerType != RouterType::RAPTOR) {
+        vector<graph::EdgeId> removedEdges;
+        vector<graph::EdgeId> addedEdges;
+        graph->Unfreeze();
+        for (auto number:routedBuses) {
+            auto it = indexBuses.find(number);
+            if (it != indexBuses.end()) {
+                RemoveBusEdges(it->second, removedEdges);
+            }
+        }
+        SyncBuses();
+        for (auto number:routedBuses) {
+            AddBusEdges(number, addedEdges);
+        }
+        graph->Freeze();
+        router->UpdateRoutes(addedEdges, removedEdges);
+    } else {
+        SyncBuses();
+    }
+    RebuildDerivedRouters();
+}
+
+void TransportRouter::AddBusEdges(std::string_view busNumber, std::vector<graph::EdgeId> &addedEdges) {
+    const size_t firstEdge = graph->GetEdgeCount();
+    if (graphModel == GraphModel::LINEAR) {
+        auto busInfo = transportCatalogue.GetBusInfo(string(busNumber));
+        nextVertexId = graph->GetVertexCount();
+        graph->AddVertices(busInfo.StopNames.size() * (busInfo.IsLoop? 1: 2));
+    }
+    BuildRoutesForBus(busNumber);
+    for (size_t edgeId = firstEdge; edgeId < graph->GetEdgeCount(); edgeId++) {
+        addedEdges.push_back(edgeId);
+    }
+}
+
+void TransportRouter::RemoveBusEdges(size_t idBus, std::vector<graph::EdgeId> &removedEdges) {
+    for (size_t edgeId = 0; edgeId < listEdges.size(); edgeId++) {
+        if (listEdges[edgeId].IdBus == idBus && !graph->IsEdgeRemoved(edgeId)) {
+            graph->RemoveEdge(edgeId);
+            removedEdges.push_back(edgeId);
+        }
+    }
+}
+
+void TransportRouter::SyncBuses() {
+    auto newBuses = transportCatalogue.GetListAllBuses();
+    map<string_view, size_t> newIndexes;
+    for (size_t i = 0; i < newBuses.size(); i++) {
+        newIndexes[newBuses[i].Number] = i;
+    }
+    for (auto &edge:listEdges) {
+        edge.IdBus = newIndexes.at(buses[edge.IdBus].Number);
+    }
+    buses = std::move(newBuses);
+    BuildIndexes();
+}
+
+void TransportRouter::RebuildDerivedRouters() {
+    BuildRaptorRouter();
+    BuildCsaRouter();
+    if (routerType == RouterType::ASTAR) {
+        BuildHeuristic();
+    }
+    routeCache.Clear();
+}
+
+void TransportRouter::CreateRouter() {
+    switch (routerType) {
+        case RouterType::RAPTOR:
+            router.reset();
+            break;
+        case RouterType::DIJKSTRA:
+            router = std::move(make_unique<graph::DijkstraRouter<double>>(*graph));
+            break;
+        case RouterType::ASTAR:
+            router = std::move(make_unique<graph::AStarRouter<double>>(*graph, [this](size_t vertex, size_t target) {
+                return GetLowerBound(vertex, target);
+            }));
+            break;
+        case RouterType::HUB_LABELS:
+            router = std::move(make_unique<graph::HubLabelRouter<double>>(*graph));
+            break;
+        default:
+            router = std::move(make_unique<graph::Router<double>>(*graph, threadCount));
+            break;
+    }
+}
+
+void TransportRouter::BuildHeuristic() {
+    // вершины "в автобусе" (LINEAR) находятся там же, где остановки их посадки и выхода
+    vertexCoords.assign(graph->GetVertexCount(), {});
+    for (size_t i = 0; i < stops.size(); i++) {
+        vertexCoords[i] = stops[i].Coord;
+    }
+    for (size_t edgeId = 0; edgeId < listEdges.size(); edgeId++) {
+        const auto &edge = graph->GetEdge(edgeId);
+        if (listEdges[edgeId].Type == EdgeType::WAIT) {
+            vertexCoords[edge.to] = stops[edge.from].Coord;
+        } else if (listEdges[edgeId].Type == EdgeType::ALIGHT) {
+            vertexCoords[edge.from] = stops[edge.to].Coord;
+        }
+    }
+    
+    // дорожное расстояние бывает короче расстояния по прямой, поэтому для допустимой
+    // оценки прямое расстояние умножается на наименьшее отношение дорожного к прямому
+    double ratio = 1;
+    for (auto &bus:buses) {
+        if (removedBuses.count(bus.Number) > 0) {
+            continue;
+        }
+        auto busInfo = transportCatalogue.GetBusInfo(string(bus.Number));
+        for (size_t i = 1; i < busInfo.StopNames.size(); i++) {
+            auto prevStop = busInfo.StopNames[i - 1];
+            auto stop = busInfo.StopNames[i];
+            double geoDistance = geo::ComputeDistance(stops[indexStops.at(prevStop)].Coord, stops[indexStops.at(stop)].Coord);
+            if (!(geoDistance > 0)) {
+                continue;
+            }
+            ratio = min(ratio, transportCatalogue.GetDistance(prevStop, stop) / geoDistance);
+            if (!busInfo.IsLoop) {
+                ratio = min(ratio, transportCatalogue.GetDistance(stop, prevStop) / geoDistance);
+            }
+        }
+    }
+    // небольшой запас на погрешность вычисления расстояний
+    heuristicScale = max(0.0, ratio) * (1 - 1e-9) / busVelocity;
+}
+
+double TransportRouter::GetLowerBound(size_t vertex, size_t target) const {
+    double geoDistance = geo::ComputeDistance(vertexCoords[vertex], vertexCoords[target]);
+    // для совпадающих точек acos может получить аргумент чуть больше единицы
+    return geoDistance > 0 ? geoDistance * heuristicScale : 0;
+}
+
+uint64_t TransportRouter::GetFingerprint(const RoutingSettings &settings) const {
+    fingerprint::FingerprintBuilder builder;
+    builder.Add(FINGERPRINT_VERSION);
+    // число потоков на результат не влияет
+    builder.Add(settings.bus_velocity);
+    builder.Add(settings.bus_wait_time);
+    builder.Add(static_cast<int>(settings.router_type));
+    builder.Add(static_cast<int>(settings.graph_model));
+    builder.Add(static_cast<uint64_t>(settings.route_cache_size));
+    
+    // номера остановок и автобусов в графе - их номера в списках по названиям
+    auto allStops = transportCatalogue.GetListAllStops();
+    builder.Add(static_cast<uint64_t>(allStops.size()));
+    for (const auto &stop:allStops) {
+        builder.Add(stop.Name);
+    }
+    auto allBuses = transportCatalogue.GetListAllBuses();
+    builder.Add(static_cast<uint64_t>(allBuses.size()));
+    for (const auto &bus:allBuses) {
+        builder.Add(bus.Number);
+        builder.Add(bus.IsLoop);
+        auto busInfo = transportCatalogue.GetBusInfo(string(bus.Number));
+        builder.Add(static_cast<uint64_t>(busInfo.StopNames.size()));
+        for (auto name:busInfo.StopNames) {
+            builder.Add(name);
+        }
+    }
+    
+    vector<tuple<string_view, string_view, int>> distances;
+    for (const auto &[from, destinations]:transportCatalogue.GetAllDistances()) {
+        for (const auto &[to, distance]:destinations) {
+            distances.emplace_back(from, to, distance);
+        }
+    }
+    sort(distances.begin(), distances.end());
+    builder.Add(static_cast<uint64_t>(distances.size()));
+    for (const auto &[from, to, distance]:distances) {
+        builder.Add(from);
+        builder.Add(to);
+        builder.Add(distance);
+    }
+    
+    map<string_view, const vector<double>*> sortedTimetables;
+    for (const auto &[number, departures]:timetables) {
+        sortedTimetables[number] = &departures;
+    }
+    builder.Add(static_cast<uint64_t>(sortedTimetables.size()));
+    for (const auto &[number, departures]:sortedTimetables) {
+        builder.Add(number);
+        builder.Add(static_cast<uint64_t>(departures->size()));
+        for (double departure:*departures) {
+            builder.Add(departure);
+        }
+    }
+    return builder.Get();
+}
+
+graph::SearchStats TransportRouter::GetSearchStats() const {
+    return router ? router->GetSearchStats() : graph::SearchStats{};
+}
+
+void TransportRouter::SetBaselineStats(bool enabled) {
+    if (router) {
+        router->SetBaselineStats(enabled);
+    }
 }
 
 void TransportRouter::BuildIndexes() {
@@ -39,10 +333,14 @@ void TransportRouter::AddEdge(std::string_view busNumber, int firstStopId,  int
     double weight = distance / busVelocity;
     weight += busWaitTime;
     
-    graph::Edge<double> edge = {static_cast<size_t>(firstStopId), static_cast<size_t>(secondStopId), weight};
+    AddGraphEdge(firstStopId, secondStopId, weight, {indexBuses[busNumber], stopCount});
+}
+
+void TransportRouter::AddGraphEdge(size_t from, size_t to, double weight, EdgeInfo info) {
+    graph::Edge<double> edge = {from, to, weight};
     graph->AddEdge(edge);
     
-    listEdges.push_back({indexBuses[busNumber], stopCount});
+    listEdges.push_back(info);
 }
 
 void TransportRouter::ScanTransportCatalogue() {
@@ -50,9 +348,24 @@ void TransportRouter::ScanTransportCatalogue() {
     stops = std::move(transportCatalogue.GetListAllStops());
     listEdges.clear();
     BuildIndexes();
+    BuildRaptorRouter();
+    BuildCsaRouter();
+    
+    // RAPTOR работает без графа
+    if (routerType == RouterType::RAPTOR) {
+        return;
+    }
+    
+    if (graphModel == GraphModel::LINEAR) {
+        // вершины остановок идут первыми, за ними цепочки маршрутов
+        graph->SetVertexCount(stops.size() + CountBusVertices());
+        nextVertexId = stops.size();
+    }
     
     for (auto &bus:buses) {
-        BuildRoutesForBus(bus.Number);
+        if (removedBuses.count(bus.Number) == 0) {
+            BuildRoutesForBus(bus.Number);
+        }
     }
 }
 
@@ -78,22 +391,312 @@ void TransportRouter::CalcDistances(string_view busNumber, const std::vector<int
     }
 }
 
-void TransportRouter::BuildRoutesForBus(string_view busNumber) {
-    auto busInfo = transportCatalogue.GetBusInfo(string(busNumber));
+void TransportRouter::BuildBusChain(string_view busNumber, const std::vector<int> &stopsId, bool isLoop) {
+    int countLoop = isLoop? 1: 2;
+    bool reverse = false;
+    int s = stopsId.size();
+    size_t idBus = indexBuses.at(busNumber);
+
+    for (int k = 0 ; k < countLoop; k++) {
+        size_t firstVertex = nextVertexId;
+        nextVertexId += s;
+        for (int i = 0; i < s; i++) {
+            size_t stopId = stopsId[reverseIndex(i, s, reverse)];
+            size_t busVertex = firstVertex + i;
+            // с последней остановки ехать некуда
+            if (i + 1 < s) {
+                AddGraphEdge(stopId, busVertex, busWaitTime, {idBus, 0, EdgeType::WAIT});
+            }
+            if (i > 0) {
+                size_t prevStopId = stopsId[reverseIndex(i - 1, s, reverse)];
+                double distance = transportCatalogue.GetDistance(stops[prevStopId].Name, stops[stopId].Name);
+                AddGraphEdge(busVertex - 1, busVertex, distance / busVelocity, {idBus, 1, EdgeType::RIDE});
+                AddGraphEdge(busVertex, stopId, 0, {idBus, 0, EdgeType::ALIGHT});
+            }
+        }
+        reverse = !reverse;
+    }
+}
+
+size_t TransportRouter::CountBusVertices() const {
+    size_t result = 0;
+    for (auto &bus:buses) {
+        if (removedBuses.count(bus.Number) > 0) {
+            continue;
+        }
+        auto busInfo = transportCatalogue.GetBusInfo(string(bus.Number));
+        result += busInfo.StopNames.size() * (busInfo.IsLoop? 1: 2);
+    }
+    return result;
+}
+
+std::vector<int> TransportRouter::GetStopsId(const domain::BusInfo &busInfo) const {
     vector<int> stopsId;
     for (size_t i = 0; i < busInfo.StopNames.size(); i++) {
-        size_t stopId = indexStops[busInfo.StopNames[i]];
-        stopsId.push_back(stopId);
+        stopsId.push_back(indexStops.at(busInfo.StopNames[i]));
     }
-    CalcDistances(busNumber, stopsId, busInfo.IsLoop);
+    return stopsId;
+}
+
+std::vector<raptor::Pattern> TransportRouter::BuildPatterns() const {
+    vector<raptor::Pattern> patterns;
+    for (size_t idBus = 0; idBus < buses.size(); idBus++) {
+        if (removedBuses.count(buses[idBus].Number) > 0) {
+            continue;
+        }
+        auto busInfo = transportCatalogue.GetBusInfo(string(buses[idBus].Number));
+        auto stopsId = GetStopsId(busInfo);
+        int countLoop = busInfo.IsLoop? 1: 2;
+        bool reverse = false;
+        int s = stopsId.size();
+        for (int k = 0 ; k < countLoop; k++) {
+            raptor::Pattern pattern;
+            pattern.bus_id = idBus;
+            double sum = 0;
+            for (int i = 0; i < s; i++) {
+                int stopId = stopsId[reverseIndex(i, s, reverse)];
+                if (i > 0) {
+                    int prevStopId = stopsId[reverseIndex(i - 1, s, reverse)];
+                    sum += transportCatalogue.GetDistance(stops[prevStopId].Name, stops[stopId].Name);
+                }
+                pattern.stops.push_back(stopId);
+                pattern.distances.push_back(sum);
+            }
+            patterns.push_back(std::move(pattern));
+            reverse = !reverse;
+        }
+    }
+    return patterns;
+}
+
+void TransportRouter::BuildRaptorRouter() {
+    raptorRouter = raptor::RaptorRouter(stops.size(), BuildPatterns(), busVelocity, busWaitTime);
+}
+
+void TransportRouter::BuildCsaRouter() {
+    if (timetables.empty()) {
+        csaRouter = csa::CsaRouter(stops.size(), {});
+        return;
+    }
+    // рейсы обоих направлений некольцевого маршрута отправляются по одному расписанию
+    vector<csa::Trip> trips;
+    for (const auto &pattern:BuildPatterns()) {
+        auto it = timetables.find(string(buses[pattern.bus_id].Number));
+        if (it == timetables.end()) {
+            continue;
+        }
+        for (double departure:it->second) {
+            csa::Trip trip{pattern.bus_id, pattern.stops, {}};
+            trip.times.reserve(pattern.distances.size());
+            for (double distance:pattern.distances) {
+                trip.times.push_back(departure + distance / busVelocity);
+            }
+            trips.push_back(std::move(trip));
+        }
+    }
+    csaRouter = csa::CsaRouter(stops.size(), trips);
+}
+
+void TransportRouter::BuildRoutesForBus(string_view busNumber) {
+    auto busInfo = transportCatalogue.GetBusInfo(string(busNumber));
+    vector<int> stopsId = GetStopsId(busInfo);
+    if (graphModel == GraphModel::LINEAR) {
+        BuildBusChain(busNumber, stopsId, busInfo.IsLoop);
+    } else {
+        CalcDistances(busNumber, stopsId, busInfo.IsLoop);
+    }
+}
+
+json::Dict TransportRouter::GetRoute(std::string from, std::string to, std::optional<int> maxTransfers,
+                                     std::optional<double> departureTime) {
+    auto firstId = FindStopId(from);
+    auto secondId = FindStopId(to);
+    if (!firstId || !secondId) {
+        return {};
+    }
+    if (departureTime) {
+        return GetTimetableRoute(*firstId, *secondId, *departureTime);
+    }
+    if (routeCache.GetCapacity() == 0) {
+        return FindRoute(*firstId, *secondId, maxTransfers);
+    }
+    
+    RouteKey key{*firstId, *secondId, maxTransfers.value_or(-1)};
+    if (auto cached = GetCachedRoute(key)) {
+        return std::move(*cached);
+    }
+    auto result = FindRoute(*firstId, *secondId, maxTransfers);
+    CacheRoute(key, result);
+    return result;
+}
+
+TransportRouter::RouteCacheStats TransportRouter::GetRouteCacheStats() const {
+    std::lock_guard<std::mutex> lock(routeCacheMutex);
+    return {routeCache.GetHits(), routeCache.GetMisses(), routeCache.GetSize()};
+}
+
+std::optional<size_t> TransportRouter::FindStopId(std::string_view name) const {
+    auto it = indexStops.find(name);
+    if (it == indexStops.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::optional<json::Dict> TransportRouter::GetCachedRoute(const RouteKey &key) {
+    std::lock_guard<std::mutex> lock(routeCacheMutex);
+    return routeCache.Get(key);
+}
+
+void TransportRouter::CacheRoute(const RouteKey &key, const json::Dict &route) {
+    std::lock_guard<std::mutex> lock(routeCacheMutex);
+    routeCache.Put(key, route);
+}
+
+json::Dict TransportRouter::FindRoute(size_t firstId, size_t secondId, std::optional<int> maxTransfers) {
+    if (routerType == RouterType::RAPTOR || maxTransfers) {
+        return BuildJourneyResult(raptorRouter.BuildRoute(firstId, secondId, maxTransfers));
+    }
+    return BuildGraphRouteResult(router->BuildRoute(firstId, secondId));
+}
+
+std::vector<json::Dict> TransportRouter::GetRoutes(const std::string &from, const std::vector<std::string> &to,
+                                                   std::optional<int> maxTransfers) {
+    std::vector<json::Dict> result(to.size());
+    auto fromId = FindStopId(from);
+    if (!fromId) {
+        return result;
+    }
+    size_t firstId = *fromId;
     
+    // из кэша берутся готовые ответы, остальные цели ищутся одним поиском
+    std::vector<size_t> targetIds;
+    std::vector<size_t> targetPositions;
+    for (size_t i = 0; i < to.size(); i++) {
+        auto toId = FindStopId(to[i]);
+        if (!toId) {
+            continue;
+        }
+        size_t secondId = *toId;
+        if (routeCache.GetCapacity() > 0) {
+            if (auto cached = GetCachedRoute({firstId, secondId, maxTransfers.value_or(-1)})) {
+                result[i] = std::move(*cached);
+                continue;
+            }
+        }
+        targetIds.push_back(secondId);
+        targetPositions.push_back(i);
+    }
+    if (targetIds.empty()) {
+        return result;
+    }
+    
+    if (routerType == RouterType::RAPTOR || maxTransfers) {
+        auto tree = raptorRouter.BuildRoutes(firstId, maxTransfers);
+        for (size_t i = 0; i < targetIds.size(); i++) {
+            result[targetPositions[i]] = BuildJourneyResult(tree.GetJourney(targetIds[i]));
+        }
+    } else {
+        auto routes = router->BuildRoutes(firstId, targetIds);
+        for (size_t i = 0; i < targetIds.size(); i++) {
+            result[targetPositions[i]] = BuildGraphRouteResult(routes[i]);
+        }
+    }
+    
+    if (routeCache.GetCapacity() > 0) {
+        for (size_t i = 0; i < targetIds.size(); i++) {
+            CacheRoute({firstId, targetIds[i], maxTransfers.value_or(-1)}, result[targetPositions[i]]);
+        }
+    }
+    return result;
 }
 
-json::Dict TransportRouter::GetRoute(std::string from, std::string to) {
-    size_t firstId = static_cast<size_t>(indexStops[from]);
-    size_t secondId = static_cast<size_t>(indexStops[to]);
-    auto tmp_result = router->BuildRoute(firstId, secondId);
-    if (!tmp_result.has_value()) {
+TransportRouter::RouteMatrix TransportRouter::GetRouteMatrix(const std::vector<std::string> &from, const std::vector<std::string> &to,
+                                                             std::optional<int> maxTransfers) const {
+    RouteMatrix result(from.size(), std::vector<std::optional<double>>(to.size()));
+    // неизвестные остановки в поиск не попадают, их строки и столбцы остаются пустыми
+    std::vector<size_t> sourceIds;
+    std::vector<size_t> sourcePositions;
+    for (size_t i = 0; i < from.size(); i++) {
+        if (auto id = FindStopId(from[i])) {
+            sourceIds.push_back(*id);
+            sourcePositions.push_back(i);
+        }
+    }
+    std::vector<size_t> targetIds;
+    std::vector<size_t> targetPositions;
+    for (size_t i = 0; i < to.size(); i++) {
+        if (auto id = FindStopId(to[i])) {
+            targetIds.push_back(*id);
+            targetPositions.push_back(i);
+        }
+    }
+    if (sourceIds.empty() || targetIds.empty()) {
+        return result;
+    }
+    
+    if (routerType == RouterType::RAPTOR || maxTransfers) {
+        for (size_t i = 0; i < sourceIds.size(); i++) {
+            auto tree = raptorRouter.BuildRoutes(sourceIds[i], maxTransfers);
+            for (size_t j = 0; j < targetIds.size(); j++) {
+                result[sourcePositions[i]][targetPositions[j]] = tree.GetTotalTime(targetIds[j]);
+            }
+        }
+        return result;
+    }
+    auto weights = router->BuildWeightMatrix(sourceIds, targetIds);
+    for (size_t i = 0; i < sourceIds.size(); i++) {
+        for (size_t j = 0; j < targetIds.size(); j++) {
+            result[sourcePositions[i]][targetPositions[j]] = weights[i][j];
+        }
+    }
+    return result;
+}
+
+std::optional<TransportRouter::Isochrone> TransportRouter::GetIsochrone(const std::string &from, double maxTime,
+                                                                        std::optional<int> maxTransfers) const {
+    auto fromId = FindStopId(from);
+    if (!fromId) {
+        return std::nullopt;
+    }
+    Isochrone result;
+    if (routerType == RouterType::RAPTOR || maxTransfers) {
+        auto tree = raptorRouter.BuildRoutes(*fromId, maxTransfers);
+        for (size_t stopId = 0; stopId < stops.size(); stopId++) {
+            auto time = tree.GetTotalTime(stopId);
+            if (time && *time <= maxTime) {
+                result.emplace_back(stops[stopId].Name, *time);
+            }
+        }
+    } else {
+        // вершины "в автобусе" (LINEAR) - не остановки
+        for (const auto &[vertex, time]:graph::BuildReachableVertices(*graph, *fromId, maxTime)) {
+            if (vertex < stops.size()) {
+                result.emplace_back(stops[vertex].Name, time);
+            }
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const auto &lhs, const auto &rhs) {
+        return std::tie(lhs.second, lhs.first) < std::tie(rhs.second, rhs.first);
+    });
+    return result;
+}
+
+json::Dict TransportRouter::GetTimetableRoute(size_t firstId, size_t secondId, double departureTime) const {
+    auto journey = csaRouter.BuildRoute(firstId, secondId, departureTime);
+    if (!journey) {
+        return {};
+    }
+    json::Array result_items;
+    for (const auto &leg:journey->legs) {
+        result_items.push_back(BuildWaitStatus(stops[leg.board_stop].Name, leg.wait_time));
+        result_items.push_back(BuildBusStatus(buses[leg.bus_id].Number, leg.span_count, leg.ride_time));
+    }
+    return BuildRouteResult(journey->arrival_time - departureTime, std::move(result_items));
+}
+
+json::Dict TransportRouter::BuildGraphRouteResult(const std::optional<graph::IRouter<double>::RouteInfo> &route) const {
+    if (!route.has_value()) {
         return json::Builder{}
                 .StartDict()
                 .EndDict().Build().AsDict();
@@ -102,20 +705,58 @@ json::Dict TransportRouter::GetRoute(std::string from, std::string to) {
                 .StartArray()
                 .EndArray().Build().AsArray();
     
-    for (auto egdeId:tmp_result.value().edges) {
-        auto edge_graph = graph->GetEdge(egdeId);
-        result_items.push_back(BuildWaitStatus(stops[static_cast<int>(edge_graph.from)].Name));
-        result_items.push_back(BuildBusStatus(buses[listEdges[egdeId].IdBus].Number, listEdges[egdeId].StopsCount,  edge_graph.weight));
+    // поездка на автобусе в модели LINEAR собирается из последовательных перегонов
+    int spanCount = 0;
+    double rideTime = 0;
+    for (auto egdeId:route->edges) {
+        const auto &edge_graph = graph->GetEdge(egdeId);
+        const auto &edge_info = listEdges[egdeId];
+        switch (edge_info.Type) {
+            case EdgeType::BUS:
+                result_items.push_back(BuildWaitStatus(stops[static_cast<int>(edge_graph.from)].Name));
+                result_items.push_back(BuildBusStatus(buses[edge_info.IdBus].Number, edge_info.StopsCount,  edge_graph.weight - busWaitTime));
+                break;
+            case EdgeType::WAIT:
+                result_items.push_back(BuildWaitStatus(stops[static_cast<int>(edge_graph.from)].Name));
+                spanCount = 0;
+                rideTime = 0;
+                break;
+            case EdgeType::RIDE:
+                spanCount += edge_info.StopsCount;
+                rideTime += edge_graph.weight;
+                break;
+            case EdgeType::ALIGHT:
+                result_items.push_back(BuildBusStatus(buses[edge_info.IdBus].Number, spanCount, rideTime));
+                break;
+        }
     }
     
+    return BuildRouteResult(route->weight, std::move(result_items));
+}
+
+json::Dict TransportRouter::BuildJourneyResult(const std::optional<raptor::Journey> &journey) const {
+    if (!journey) {
+        return json::Builder{}
+                .StartDict()
+                .EndDict().Build().AsDict();
+    }
+    json::Array result_items;
+    for (const auto &leg:journey->legs) {
+        result_items.push_back(BuildWaitStatus(stops[leg.board_stop].Name));
+        result_items.push_back(BuildBusStatus(buses[leg.bus_id].Number, leg.span_count, leg.ride_time));
+    }
+    return BuildRouteResult(journey->total_time, std::move(result_items));
+}
+
+json::Dict TransportRouter::BuildRouteResult(double totalTime, json::Array items) const {
     return json::Builder{}
                 .StartDict()
-                    .Key("total_time").Value(tmp_result.value().weight)
-                    .Key("items").Value(result_items)
+                    .Key("total_time").Value(totalTime)
+                    .Key("items").Value(items)
                 .EndDict().Build().AsDict();
 }
 
-json::Dict TransportRouter::BuildWaitStatus(std::string_view stopName) {
+json::Dict TransportRouter::BuildWaitStatus(std::string_view stopName) const {
     return json::Builder{}
                 .StartDict()
                     .Key("type").Value("Wait")
@@ -124,38 +765,92 @@ json::Dict TransportRouter::BuildWaitStatus(std::string_view stopName) {
                 .EndDict().Build().AsDict();
 }
 
-json::Dict TransportRouter::BuildBusStatus(std::string_view busNumber, int stopCount, double time) {
+json::Dict TransportRouter::BuildWaitStatus(std::string_view stopName, double time) const {
+    return json::Builder{}
+                .StartDict()
+                    .Key("type").Value("Wait")
+                    .Key("stop_name").Value(string(stopName))
+                    .Key("time").Value(time)
+                .EndDict().Build().AsDict();
+}
+
+json::Dict TransportRouter::BuildBusStatus(std::string_view busNumber, int stopCount, double time) const {
     return json::Builder{}
                 .StartDict()
                     .Key("type").Value("Bus")
                     .Key("bus").Value(string(busNumber))
                     .Key("span_count").Value(stopCount)
-                    .Key("time").Value(time - busWaitTime)
+                    .Key("time").Value(time)
                 .EndDict().Build().AsDict();
 }
 
 void TransportRouter::SerializeGraph(transport_router_serialize::TransportRouter &serialData) const {
+    serialData.mutable_graph()->set_vertex_count(graph->GetVertexCount());
     size_t count = graph->GetEdgeCount();
     for (size_t i = 0; i < count; i++) {
-        auto edge = graph->GetEdge(i);
+        const auto &edge = graph->GetEdge(i);
         graph_serialize::Edge edge_proto;
         edge_proto.set_from(edge.from);
         edge_proto.set_to(edge.to);
         edge_proto.set_weight(edge.weight);
         *serialData.mutable_graph()->add_list_edges() = edge_proto;
+        if (graph->IsEdgeRemoved(i)) {
+            serialData.mutable_graph()->add_removed_edges(i);
+        }
     }
 }
     
 void TransportRouter::DeserializeGraph(const transport_router_serialize::TransportRouter &serialData) {
-    graph->Reset();
-    graph->SetVertexCount(transportCatalogue.GetCountStops());
     int count = serialData.graph().list_edges_size();
+    vector<graph::Edge<double>> edges;
+    edges.reserve(count);
     for (int i = 0; i < count; i++) {
         graph::Edge<double> edge;
         edge.from = serialData.graph().list_edges(i).from();
         edge.to = serialData.graph().list_edges(i).to();
         edge.weight = serialData.graph().list_edges(i).weight();
-        graph->AddEdge(edge);
+        edges.push_back(edge);
+    }
+    // в старых базах число вершин не хранилось и совпадало с числом остановок
+    size_t vertexCount = serialData.graph().vertex_count();
+    if (vertexCount == 0) {
+        vertexCount = transportCatalogue.GetCountStops();
+    }
+    ResetGraph(vertexCount, std::move(edges), serialData);
+}
+
+void TransportRouter::ResetGraph(size_t vertexCount, std::vector<graph::Edge<double>> edges,
+                                 const transport_router_serialize::TransportRouter &serialData) {
+    vector<bool> removedEdges;
+    if (serialData.graph().removed_edges_size() > 0) {
+        removedEdges.assign(edges.size(), false);
+        for (auto edgeId:serialData.graph().removed_edges()) {
+            removedEdges.at(edgeId) = true;
+        }
+    }
+    // граф заменяется на месте: маршрутизатор хранит ссылку на него
+    *graph = graph::DirectedWeightedGraph<double>(vertexCount, std::move(edges), std::move(removedEdges));
+}
+
+void TransportRouter::SerializeTimetables(transport_router_serialize::TransportRouter &serialData) const {
+    for (const auto &[number, departures]:timetables) {
+        auto it = indexBuses.find(number);
+        if (it == indexBuses.end()) {
+            continue;
+        }
+        auto &timetable_proto = *serialData.mutable_timetable()->add_buses();
+        timetable_proto.set_id_bus(it->second);
+        for (double departure:departures) {
+            timetable_proto.add_departures(departure);
+        }
+    }
+}
+
+void TransportRouter::DeserializeTimetables(const transport_router_serialize::TransportRouter &serialData) {
+    timetables.clear();
+    for (const auto &timetable_proto:serialData.timetable().buses()) {
+        auto &departures = timetables[string(buses.at(timetable_proto.id_bus()).Number)];
+        departures.assign(timetable_proto.departures().begin(), timetable_proto.departures().end());
     }
 }
 
@@ -164,6 +859,7 @@ void TransportRouter::SerializeListEdges(transport_router_serialize::TransportRo
         transport_router_serialize::EdgeInfo edge_proto;
         edge_proto.set_id_bus(edge.IdBus);
         edge_proto.set_stops_count(edge.StopsCount);
+        edge_proto.set_type(static_cast<transport_router_serialize::EdgeType>(edge.Type));
         *serialData.add_list_edges() = edge_proto;
     }
 }
@@ -171,10 +867,12 @@ void TransportRouter::SerializeListEdges(transport_router_serialize::TransportRo
 void TransportRouter::DeserializeListEdges(const transport_router_serialize::TransportRouter &serialData) {
     int count = serialData.list_edges_size();
     listEdges.clear();
+    listEdges.reserve(count);
     for (int i = 0; i < count; i++) {
         EdgeInfo edge;
         edge.IdBus = serialData.list_edges(i).id_bus();
         edge.StopsCount = serialData.list_edges(i).stops_count();
+        edge.Type = static_cast<EdgeType>(serialData.list_edges(i).type());
         listEdges.push_back(edge);
     }
 }
@@ -182,16 +880,36 @@ void TransportRouter::DeserializeListEdges(const transport_router_serialize::Tra
 void TransportRouter::SerializeRoutersSettings(transport_router_serialize::TransportRouter &serialData) const {
     serialData.set_bus_velocity(busVelocity);
     serialData.set_bus_wait_time(busWaitTime);
+    serialData.set_router_type(static_cast<transport_router_serialize::RouterType>(routerType));
+    serialData.set_route_cache_size(routeCache.GetCapacity());
+    for (const auto &number:removedBuses) {
+        serialData.add_removed_buses(indexBuses.at(number));
+    }
+    serialData.set_graph_model(graphModel == GraphModel::LINEAR
+        ? transport_router_serialize::GRAPH_LINEAR
+        : transport_router_serialize::GRAPH_PAIRWISE);
 }
     
 void TransportRouter::DeserializeRoutersSettings(const transport_router_serialize::TransportRouter &serialData) {
     busVelocity = serialData.bus_velocity();
     busWaitTime = serialData.bus_wait_time();
+    routerType = static_cast<RouterType>(serialData.router_type());
+    graphModel = serialData.graph_model() == transport_router_serialize::GRAPH_LINEAR
+        ? GraphModel::LINEAR
+        : GraphModel::PAIRWISE;
+    routeCache.Clear();
+    routeCache.SetCapacity(serialData.route_cache_size());
+}
+
+void TransportRouter::DeserializeRemovedBuses(const transport_router_serialize::TransportRouter &serialData) {
+    removedBuses.clear();
+    for (auto idBus:serialData.removed_buses()) {
+        removedBuses.insert(string(buses.at(idBus).Number));
+    }
 }
 
 void TransportRouter::InitDeserialize() {
     graph = std::move(make_unique<graph::DirectedWeightedGraph<double>>());
-    router = std::move(make_unique<graph::Router<double>>(*graph));
     
     buses = std::move(transportCatalogue.GetListAllBuses());
     stops = std::move(transportCatalogue.GetListAllStops());
@@ -201,15 +919,126 @@ void TransportRouter::InitDeserialize() {
 
 void TransportRouter::Serialize(transport_router_serialize::TransportRouter &serialData) const {
     SerializeRoutersSettings(serialData);
+    SerializeTimetables(serialData);
     SerializeListEdges(serialData);
     SerializeGraph(serialData);
-    router->Serialize(serialData);
+    if (router) {
+        router->Serialize(serialData);
+    }
+}
+    
+void TransportRouter::SerializeHead(transport_router_serialize::TransportRouter &serialData) const {
+    SerializeRoutersSettings(serialData);
+    SerializeTimetables(serialData);
+    SerializeListEdges(serialData);
+    SerializeGraph(serialData);
+    if (router) {
+        router->SerializeHead(serialData);
+    }
+}
+    
+void TransportRouter::SerializeChunks(const graph::IRouter<double>::ChunkWriter &writeChunk) const {
+    if (router) {
+        router->SerializeChunks(writeChunk);
+    }
 }
     
 void TransportRouter::Deserialize(const transport_router_serialize::TransportRouter &serialData) {
+    DeserializeHead(serialData);
+    FinishChunks();
+}
+    
+void TransportRouter::DeserializeChunk(const transport_router_serialize::TransportRouter &chunk) {
+    if (!router) {
+        throw runtime_error("Router data chunk without router");
+    }
+    router->DeserializeChunk(chunk);
+}
+    
+void TransportRouter::FinishChunks() {
+    if (router) {
+        router->FinishChunks();
+    }
+}
+    
+void TransportRouter::DeserializeHead(const transport_router_serialize::TransportRouter &serialData) {
     InitDeserialize();
     DeserializeRoutersSettings(serialData);
+    DeserializeRemovedBuses(serialData);
+    // маршрутизатор создаётся по пустому графу, данные загружаются в Deserialize
+    CreateRouter();
     DeserializeListEdges(serialData);
     DeserializeGraph(serialData);
-    router->Deserialize(serialData);
+    LoadRouters(serialData, nullptr);
+}
+
+void TransportRouter::LoadRouters(const transport_router_serialize::TransportRouter &serialData, const flat::BaseReader *reader) {
+    if (routerType == RouterType::ASTAR) {
+        BuildHeuristic();
+    }
+    // данные маршрутизатора не нужны RAPTOR и CSA, они строятся параллельно с их загрузкой
+    parallel::ThreadPool pool(threadCount == 1 ? 1 : 2);
+    auto routerLoaded = pool.Submit([&] {
+        if (router && !(reader && router->LoadSections(*reader))) {
+            router->Deserialize(serialData);
+        }
+    });
+    try {
+        BuildRaptorRouter();
+        DeserializeTimetables(serialData);
+        BuildCsaRouter();
+    } catch (...) {
+        routerLoaded.wait();
+        throw;
+    }
+    routerLoaded.get();
+}
+
+void TransportRouter::SaveSections(transport_router_serialize::TransportRouter &serialData, flat::BaseWriter &writer) const {
+    SerializeRoutersSettings(serialData);
+    SerializeTimetables(serialData);
+    
+    vector<flat::EdgeInfoRecord> edgeInfos;
+    edgeInfos.reserve(listEdges.size());
+    for (const auto &edge:listEdges) {
+        edgeInfos.push_back({static_cast<uint32_t>(edge.IdBus), edge.StopsCount, static_cast<uint32_t>(edge.Type)});
+    }
+    writer.AddArray(flat::SectionId::EDGE_INFO, edgeInfos);
+    
+    serialData.mutable_graph()->set_vertex_count(graph->GetVertexCount());
+    vector<flat::EdgeRecord> edges;
+    edges.reserve(graph->GetEdgeCount());
+    for (size_t i = 0; i < graph->GetEdgeCount(); i++) {
+        const auto &edge = graph->GetEdge(i);
+        edges.push_back({static_cast<uint32_t>(edge.from), static_cast<uint32_t>(edge.to), edge.weight});
+        if (graph->IsEdgeRemoved(i)) {
+            serialData.mutable_graph()->add_removed_edges(i);
+        }
+    }
+    writer.AddArray(flat::SectionId::GRAPH_EDGES, edges);
+    
+    if (router && !router->SaveSections(writer)) {
+        router->Serialize(serialData);
+    }
+}
+
+void TransportRouter::LoadSections(const transport_router_serialize::TransportRouter &serialData, const flat::BaseReader &reader) {
+    InitDeserialize();
+    DeserializeRoutersSettings(serialData);
+    DeserializeRemovedBuses(serialData);
+    CreateRouter();
+    
+    listEdges.clear();
+    for (const auto &edge:reader.GetArray<flat::EdgeInfoRecord>(flat::SectionId::EDGE_INFO)) {
+        listEdges.push_back({edge.id_bus, edge.stops_count, static_cast<EdgeType>(edge.type)});
+    }
+    auto edgeRecords = reader.GetArray<flat::EdgeRecord>(flat::SectionId::GRAPH_EDGES);
+    vector<graph::Edge<double>> edges;
+    edges.reserve(edgeRecords.size);
+    for (const auto &edge:edgeRecords) {
+        edges.push_back({edge.from, edge.to, edge.weight});
+    }
+    ResetGraph(serialData.graph().vertex_count(), std::move(edges), serialData);
+    LoadRouters(serialData, &reader);
+    FinishChunks();
 }
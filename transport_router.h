@@ -4,46 +4,210 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <optional>
 #include <functional>
 #include <string_view>
 #include <transport_router.pb.h>
 
 #include "domain.h"
+#include "flat_base.h"
 #include "transport_catalogue.h"
 #include "router.h"
+#include "dijkstra_router.h"
+#include "astar_router.h"
+#include "hub_label_router.h"
+#include "raptor_router.h"
+#include "csa_router.h"
 #include "graph.h"
 #include "json.h"
+#include "lru_cache.h"
 
 const double KmH_To_MMin = 1000.0 / 60;
 
+// алгоритм поиска маршрута
+enum class RouterType {
+    ALL_PAIRS,  // предрасчёт всех пар остановок (Флойд - Уоршелл)
+    DIJKSTRA,   // поиск по запросу (двунаправленный Дейкстра)
+    RAPTOR,     // поиск по раундам по маршрутам автобусов, без графа
+    ASTAR,      // поиск по запросу (A* с оценкой по расстоянию по прямой)
+    HUB_LABELS  // предрасчёт 2-hop меток, запрос - пересечение двух меток
+};
+
+// модель графа
+enum class GraphModel {
+    PAIRWISE,  // ребро на каждую пару остановок маршрута, O(L^2) рёбер
+    LINEAR     // вершины "на остановке" и "в автобусе", O(L) рёбер
+};
+
+struct RoutingSettings {
+    double bus_velocity = 0;
+    int bus_wait_time = 0;
+    RouterType router_type = RouterType::ALL_PAIRS;
+    GraphModel graph_model = GraphModel::PAIRWISE;
+    // число потоков построения маршрутизатора (0 - по числу ядер)
+    size_t thread_count = 0;
+    // число запоминаемых ответов на запросы маршрутов (0 - без кэша)
+    size_t route_cache_size = 0;
+};
+
 class TransportRouter {
 public:
     
+    // тип ребра графа
+    enum class EdgeType {
+        BUS,     // ожидание и поездка на StopsCount остановок (PAIRWISE)
+        WAIT,    // посадка в автобус на остановке (LINEAR)
+        RIDE,    // перегон до следующей остановки (LINEAR)
+        ALIGHT   // выход из автобуса на остановку (LINEAR)
+    };
+    
     struct EdgeInfo {
         size_t IdBus;
         int StopsCount;
+        EdgeType Type = EdgeType::BUS;
+    };
+    
+    struct RouteCacheStats {
+        size_t hits;
+        size_t misses;
+        size_t size;
     };
     
     TransportRouter(transport_cataloge::TransportCatalogue &newTransportCatalogue): transportCatalogue(newTransportCatalogue) {}
     
-    void BuildRouter(double bus_velocity ,int bus_wait_time);
+    void BuildRouter(const RoutingSettings &settings);
+    
+    // расписания автобусов, задаются до построения маршрутизатора
+    void SetTimetables(std::vector<domain::BusTimetable> newTimetables);
+    
+    // добавление в построенный маршрутизатор автобуса, уже добавленного в каталог
+    // (или ранее исключённого); пересчитывается только затронутая часть данных,
+    // все остановки автобуса должны быть известны маршрутизатору
+    void AddBus(std::string_view busNumber);
+    
+    // исключение автобуса из маршрутизации, в каталоге автобус остаётся
+    void RemoveBus(std::string_view busNumber);
+    
+    // пересборка рёбер автобусов, новых или изменённых в каталоге (путь, расстояния),
+    // одним пересчётом затронутой части таблицы; координаты остановок перечитываются,
+    // с новыми остановками маршрутизатор строится заново с прежними настройками
+    void UpdateBuses(const std::vector<std::string> &busNumbers);
+    
+    // maxTransfers - ограничение числа пересадок, такие запросы решаются RAPTOR;
+    // после построения вызов безопасен из нескольких потоков
+    // departureTime - момент появления на остановке, такие запросы решаются по расписанию (CSA)
+    // и не кэшируются
+    json::Dict GetRoute(std::string from, std::string to, std::optional<int> maxTransfers = std::nullopt,
+                        std::optional<double> departureTime = std::nullopt);
+    
+    // маршруты из одной остановки до нескольких за один поиск, в порядке to
+    std::vector<json::Dict> GetRoutes(const std::string &from, const std::vector<std::string> &to,
+                                      std::optional<int> maxTransfers = std::nullopt);
+    
+    // время пути для всех пар from x to без построения маршрутов, строка на каждую остановку from;
+    // нет значения - маршрута нет или остановка неизвестна
+    using RouteMatrix = std::vector<std::vector<std::optional<double>>>;
+    RouteMatrix GetRouteMatrix(const std::vector<std::string> &from, const std::vector<std::string> &to,
+                               std::optional<int> maxTransfers = std::nullopt) const;
     
-    json::Dict GetRoute(std::string from, std::string to);
+    // остановки, до которых из from можно доехать не дольше maxTime, и время пути до них,
+    // по возрастанию времени; нет значения - остановка from неизвестна
+    using Isochrone = std::vector<std::pair<std::string_view, double>>;
+    std::optional<Isochrone> GetIsochrone(const std::string &from, double maxTime,
+                                          std::optional<int> maxTransfers = std::nullopt) const;
     
     void Serialize(transport_router_serialize::TransportRouter &serialData) const;
     
     void Deserialize(const transport_router_serialize::TransportRouter &serialData);
     
+    // потоковая запись и загрузка: заголовок - всё, кроме больших массивов маршрутизатора,
+    // они идут следом кусками (graph::IRouter::SerializeChunks)
+    void SerializeHead(transport_router_serialize::TransportRouter &serialData) const;
+    void SerializeChunks(const graph::IRouter<double>::ChunkWriter &writeChunk) const;
+    void DeserializeHead(const transport_router_serialize::TransportRouter &serialData);
+    void DeserializeChunk(const transport_router_serialize::TransportRouter &chunk);
+    void FinishChunks();
+    
+    // плоская база: рёбра графа, их описания и таблица маршрутизатора - отдельными секциями,
+    // остальное - в serialData
+    void SaveSections(transport_router_serialize::TransportRouter &serialData, flat::BaseWriter &writer) const;
+    void LoadSections(const transport_router_serialize::TransportRouter &serialData, const flat::BaseReader &reader);
+    
+    RouteCacheStats GetRouteCacheStats() const;
+    
+    // счётчики поисков маршрутизатора по запросу (Дейкстра, A*)
+    graph::SearchStats GetSearchStats() const;
+    // подсчёт вершин поисков A* без эвристики, действует до пересборки маршрутизатора
+    void SetBaselineStats(bool enabled);
+    
+    // отпечаток входных данных маршрутизатора с настройками settings: названия остановок,
+    // пути маршрутов, расстояния и расписания; координаты остановок в него не входят -
+    // оценка A* по ним строится при загрузке; считается до построения, 0 не бывает
+    uint64_t GetFingerprint(const RoutingSettings &settings) const;
+    
 private:
+    // ключ кэша маршрутов, maxTransfers == -1 - без ограничения пересадок
+    struct RouteKey {
+        size_t from;
+        size_t to;
+        int maxTransfers;
+        
+        bool operator==(const RouteKey &other) const {
+            return from == other.from && to == other.to && maxTransfers == other.maxTransfers;
+        }
+    };
+    
+    struct RouteKeyHasher {
+        size_t operator()(const RouteKey &key) const {
+            return (key.from * 37 + key.to) * 37 + static_cast<size_t>(key.maxTransfers + 1);
+        }
+    };
+    
     // траспортный каталог
     transport_cataloge::TransportCatalogue &transportCatalogue;
     
     // маршрутизатор
-    std::unique_ptr<graph::Router<double>> router;
+    std::unique_ptr<graph::IRouter<double>> router;
+    
+    // алгоритм маршрутизатора
+    RouterType routerType = RouterType::ALL_PAIRS;
+    
+    // модель графа
+    GraphModel graphModel = GraphModel::PAIRWISE;
+    
+    // первая свободная вершина для цепочек "в автобусе" (LINEAR)
+    size_t nextVertexId = 0;
+    
+    // число потоков построения маршрутизатора
+    size_t threadCount = 0;
     
     // граф для маршрутизатора
     std::unique_ptr<graph::DirectedWeightedGraph<double>> graph;
     
+    // координаты остановки каждой вершины графа (ASTAR)
+    std::vector<geo::Coordinates> vertexCoords;
+    
+    // множитель нижней оценки времени по расстоянию по прямой (ASTAR)
+    double heuristicScale = 0;
+    
+    // маршрутизатор по последовательностям остановок (строится всегда)
+    raptor::RaptorRouter raptorRouter;
+    
+    // автобусы каталога, исключённые из маршрутизации
+    std::set<std::string, std::less<>> removedBuses;
+    
+    // расписания: номер автобуса -> отправления рейсов
+    std::unordered_map<std::string, std::vector<double>> timetables;
+    
+    // маршрутизатор по расписанию (строится при наличии расписаний)
+    csa::CsaRouter csaRouter;
+    
+    // кэш готовых ответов на запросы маршрутов, общий для потоков обработки запросов
+    cache::LruCache<RouteKey, json::Dict, RouteKeyHasher> routeCache;
+    mutable std::mutex routeCacheMutex;
+    
     // скорость автобуса (м/мин)
     double busVelocity;
     
@@ -68,22 +232,87 @@ private:
     // добавление участка пути
     void AddEdge(std::string_view busNumber, int firstStopId, int secondStopId, double distance, int stopCount);
     
+    // добавление ребра графа с его описанием
+    void AddGraphEdge(size_t from, size_t to, double weight, EdgeInfo info);
+    
     // сканирование транспортного каталога и построение графа
     void ScanTransportCatalogue();
+    
+    // построение графа и маршрутизатора по текущим настройкам
+    void BuildGraph();
+    
+    // рёбра автобуса в конец размороженного графа
+    void AddBusEdges(std::string_view busNumber, std::vector<graph::EdgeId> &addedEdges);
+    
+    // удаление рёбер автобуса из размороженного графа
+    void RemoveBusEdges(size_t idBus, std::vector<graph::EdgeId> &removedEdges);
 
     // построение индекса остановок
     void BuildIndexes();
     
+    // перечитывание списка автобусов каталога с перенумерацией автобусов в описаниях рёбер
+    void SyncBuses();
+    
+    // перестроение маршрутизаторов, которые дёшево строятся заново, после изменения автобусов
+    void RebuildDerivedRouters();
+    
+    // индекс остановки по названию (нет - остановка неизвестна), без изменения индекса
+    std::optional<size_t> FindStopId(std::string_view name) const;
+    
+    // обращения к кэшу маршрутов под блокировкой
+    std::optional<json::Dict> GetCachedRoute(const RouteKey &key);
+    void CacheRoute(const RouteKey &key, const json::Dict &route);
+    
+    // подготовка нижней оценки времени пути для A*
+    void BuildHeuristic();
+    
+    // нижняя оценка времени пути между вершинами графа
+    double GetLowerBound(size_t vertex, size_t target) const;
+    
+    // поиск маршрута без кэша
+    json::Dict FindRoute(size_t firstId, size_t secondId, std::optional<int> maxTransfers);
+    
     // построение рёбер для заданного маршрута
     void BuildRoutesForBus(std::string_view);
     // построение расстояний всех возможных пар остановок (по маршруту)
     void CalcDistances(std::string_view busNumber, const std::vector<int> &stopsId, bool isLoop);
     
-    // построение статуса "wait" для результата
-    json::Dict BuildWaitStatus(std::string_view stopName);
+    // построение цепочки вершин "в автобусе" для маршрута (LINEAR)
+    void BuildBusChain(std::string_view busNumber, const std::vector<int> &stopsId, bool isLoop);
+    
+    // число вершин "в автобусе" для всех маршрутов (LINEAR)
+    size_t CountBusVertices() const;
+    
+    // индексы остановок маршрута
+    std::vector<int> GetStopsId(const domain::BusInfo &busInfo) const;
+    
+    // направления всех автобусов: остановки и расстояния от начала направления
+    std::vector<raptor::Pattern> BuildPatterns() const;
+    
+    // построение маршрутизатора RAPTOR по направлениям всех автобусов
+    void BuildRaptorRouter();
+    
+    // построение маршрутизатора CSA по рейсам из расписаний
+    void BuildCsaRouter();
+    
+    // поиск маршрута по расписанию
+    json::Dict GetTimetableRoute(size_t firstId, size_t secondId, double departureTime) const;
+    
+    // ответ на запрос маршрута по рёбрам графа
+    json::Dict BuildGraphRouteResult(const std::optional<graph::IRouter<double>::RouteInfo> &route) const;
+    
+    // ответ на запрос маршрута по поездкам RAPTOR
+    json::Dict BuildJourneyResult(const std::optional<raptor::Journey> &journey) const;
+    
+    // сборка ответа на запрос маршрута
+    json::Dict BuildRouteResult(double totalTime, json::Array items) const;
     
     // построение статуса "wait" для результата
-    json::Dict BuildBusStatus(std::string_view busNumber, int stopCount, double time);
+    json::Dict BuildWaitStatus(std::string_view stopName) const;
+    json::Dict BuildWaitStatus(std::string_view stopName, double time) const;
+    
+    // построение статуса "bus" для результата
+    json::Dict BuildBusStatus(std::string_view busNumber, int stopCount, double time) const;
     
     // сериализация графа
     void SerializeGraph(transport_router_serialize::TransportRouter &serialData) const;
@@ -91,6 +320,22 @@ private:
     // десериализация графа
     void DeserializeGraph(const transport_router_serialize::TransportRouter &serialData);
     
+    // замена графа на построенный по готовому списку рёбер
+    void ResetGraph(size_t vertexCount, std::vector<graph::Edge<double>> edges,
+                    const transport_router_serialize::TransportRouter &serialData);
+    
+    // загрузка маршрутизаторов после чтения графа и описаний рёбер
+    void LoadRouters(const transport_router_serialize::TransportRouter &serialData, const flat::BaseReader *reader);
+    
+    // десериализация исключённых автобусов
+    void DeserializeRemovedBuses(const transport_router_serialize::TransportRouter &serialData);
+    
+    // сериализация расписаний
+    void SerializeTimetables(transport_router_serialize::TransportRouter &serialData) const;
+    
+    // десериализация расписаний
+    void DeserializeTimetables(const transport_router_serialize::TransportRouter &serialData);
+    
     // сериализация списка рёбер
     void SerializeListEdges(transport_router_serialize::TransportRouter &serialData) const;
     
@@ -106,4 +351,7 @@ private:
     // начальные действия при десериализации
     void InitDeserialize();
     
+    // создание маршрутизатора выбранного типа по текущему графу
+    void CreateRouter();
+    
 };